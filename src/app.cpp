@@ -21,6 +21,147 @@ App::App(int argc, char *argv[]) {
       .default_value(6)
       .scan<'i', int>();
 
+  program.add_argument("--ipf")
+      .help("Instructions per 60Hz frame, 0 derives it from --delay.")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("--headless")
+      .help("Run without a window as fast as possible, requires --frames.")
+      .default_value(false)
+      .implicit_value(true);
+
+  program.add_argument("--frames")
+      .help("Number of frames to run, 0 runs until the window is closed.")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("--record")
+      .help("Record the display to the given file.")
+      .default_value(std::string(""));
+
+  program.add_argument("--record-format")
+      .help("Record format: raw, y4m or gif. Guessed from the file "
+            "extension if not given.")
+      .default_value(std::string(""));
+
+  program.add_argument("--mute")
+      .help("Disable sound.")
+      .default_value(false)
+      .implicit_value(true);
+
+  program.add_argument("--audio-buffer")
+      .help("Audio buffer size in samples, smaller is lower latency.")
+      .default_value(256)
+      .scan<'i', int>();
+
+  program.add_argument("--latency")
+      .help("Track input latency, F1 toggles the overlay, a histogram is "
+            "printed on exit.")
+      .default_value(false)
+      .implicit_value(true);
+
+  program.add_argument("--debug")
+      .help("Start paused in the terminal debugger.")
+      .default_value(false)
+      .implicit_value(true);
+
+  program.add_argument("--gdb")
+      .help("Start paused and wait for gdb on the given localhost port.")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("--vsync")
+      .help("Present with vsync, emulation speed is not affected.")
+      .default_value(false)
+      .implicit_value(true);
+
+  program.add_argument("--filter")
+      .help("Anti-flicker filter of the window: none, decay fades pixels out "
+            "like phosphor, or keeps pixels lit for --filter-frames frames.")
+      .default_value(std::string("none"));
+
+  program.add_argument("--decay")
+      .help("Share of its brightness a pixel keeps per frame with --filter "
+            "decay.")
+      .default_value(0.5)
+      .scan<'g', double>();
+
+  program.add_argument("--filter-frames")
+      .help("Frames a pixel stays lit with --filter or.")
+      .default_value(2)
+      .scan<'i', int>();
+
+  program.add_argument("--grid")
+      .help("Run a grid of instances such as 4x4 in one window, each seeded "
+            "differently.")
+      .default_value(std::string(""));
+
+  program.add_argument("--farm")
+      .help("Run this many instances as coroutines for --frames frames, in "
+            "real time unless --headless.")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("--threads")
+      .help("Scheduler threads for --farm, 0 uses every core.")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("--seed")
+      .help("Seed of the random number generator, seeded from the clock if "
+            "not given.")
+      .scan<'u', uint64_t>();
+
+  program.add_argument("--record-input")
+      .help("Record the keypad to the given input movie file.")
+      .default_value(std::string(""));
+
+  program.add_argument("--play-input")
+      .help("Replay the keypad, seed, ipf, timing and policies from the "
+            "given input movie file, with --headless as fast as possible.")
+      .default_value(std::string(""));
+
+  program.add_argument("--memory-policy")
+      .help("Memory accesses past 0xFFF either wrap around or trap, which "
+            "stops the machine.")
+      .default_value(std::string("wrap"));
+
+  program.add_argument("--stack-policy")
+      .help("Calls with a full stack and returns with an empty one either "
+            "wrap around or trap, which stops the machine.")
+      .default_value(std::string("wrap"));
+
+  program.add_argument("--metrics")
+      .help("Write Prometheus metrics of --headless and --farm runs to this "
+            "file, or serve them on localhost:PORT.")
+      .default_value(std::string(""));
+
+  program.add_argument("--metrics-interval")
+      .help("Seconds between metrics file writes.")
+      .default_value(1.0)
+      .scan<'g', double>();
+
+  program.add_argument("--stream")
+      .help("Stream the display of a --headless or --farm run to viewers "
+            "such as cipi8-view on this unix socket, which send keys back.")
+      .default_value(std::string(""));
+
+  program.add_argument("--stream-instance")
+      .help("Farm instance streamed by --stream.")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("--timing")
+      .help("Pacing: instructions runs --ipf instructions per frame, vip "
+            "charges every instruction its COSMAC VIP machine cycles.")
+      .default_value(std::string("instructions"));
+
+  program.add_argument("--verbose")
+      .help("Log info messages, such as timing and latency reports.")
+      .default_value(false)
+      .implicit_value(true);
+
   try {
     program.parse_args(argc, argv);
   } catch (const std::exception &err) {
@@ -29,6 +170,12 @@ App::App(int argc, char *argv[]) {
     std::exit(1);
   }
 
+#ifndef CIPI8_DEBUG_MODE
+  if (program.get<bool>("--verbose")) {
+    nhlog_set_level(NHLOG_INFO);
+  }
+#endif
+
   auto raw_filename = program.get<std::string>("rom_file");
 
   // if file doesnt exist
@@ -41,34 +188,660 @@ App::App(int argc, char *argv[]) {
   this->filename = raw_filename;
   this->delay = program.get<int>("--delay");
   this->scale = program.get<int>("--scale");
-  nhlog_info("filename=%s, delay=%d, scale=%d", raw_filename.c_str(),
-             this->delay, this->scale);
+  this->headless = program.get<bool>("--headless");
+  this->frames = std::max(program.get<int>("--frames"), 0);
+
+  // keep the old pacing of one cycle every `delay` ms by default.
+  int ipf = program.get<int>("--ipf");
+  if (ipf <= 0) {
+    ipf = std::max(1, (int)std::lround(1000.0 / 60.0 / std::max(delay, 1)));
+  }
+  this->ipf = ipf;
+
+  auto timing = program.get<std::string>("--timing");
+  if (!Chip8::parse_timing(timing, this->timing)) {
+    nhlog_error("Unknown timing %s, expected instructions or vip.",
+                timing.c_str());
+    exit(EXIT_FAILURE);
+  }
+
+  auto memory_policy = program.get<std::string>("--memory-policy");
+  auto stack_policy = program.get<std::string>("--stack-policy");
+  if (!Chip8::parse_policy(memory_policy, this->memory_policy) ||
+      !Chip8::parse_policy(stack_policy, this->stack_policy)) {
+    nhlog_error("Policies are either wrap or trap.");
+    exit(EXIT_FAILURE);
+  }
+
+  auto seed = program.present<uint64_t>("--seed");
+  this->seeded = seed.has_value();
+  this->seed = seed.value_or(0);
+
+  this->record_input = program.get<std::string>("--record-input");
+  this->play_input = program.get<std::string>("--play-input");
+  if (!this->record_input.empty() && !this->play_input.empty()) {
+    nhlog_error("--record-input and --play-input can't be used together.");
+    exit(EXIT_FAILURE);
+  }
+  if (!this->record_input.empty() && this->headless) {
+    nhlog_error("--record-input needs a window to take input from.");
+    exit(EXIT_FAILURE);
+  }
+
+  // a replay runs exactly as recorded, headless it runs the whole movie.
+  if (!this->play_input.empty()) {
+    if (!this->movie.load(this->play_input)) {
+      exit(EXIT_FAILURE);
+    }
+    this->ipf = std::max(this->movie.ipf, 1u);
+    this->timing =
+        this->movie.ipf == 0 ? Timing::VIP : Timing::INSTRUCTIONS;
+    this->memory_policy = this->movie.memory_policy;
+    this->stack_policy = this->movie.stack_policy;
+    this->seeded = true;
+    this->seed = this->movie.seed;
+    if (this->headless && this->frames == 0) {
+      this->frames = this->movie.frames;
+    }
+  }
+
+  // a recording stores its seed, so pick one now rather than in Chip8.
+  if (!this->record_input.empty()) {
+    if (!this->seeded) {
+      this->seeded = true;
+      this->seed = std::random_device()();
+    }
+    this->movie.seed = this->seed;
+    this->movie.ipf = this->timing == Timing::VIP ? 0 : this->ipf;
+    this->movie.memory_policy = this->memory_policy;
+    this->movie.stack_policy = this->stack_policy;
+  }
+
+  if (this->headless && this->frames == 0) {
+    nhlog_error("--headless requires --frames or --play-input.");
+    exit(EXIT_FAILURE);
+  }
+
+  this->record_file = program.get<std::string>("--record");
+  this->record_format = RecordFormat::RAW;
+  auto format = program.get<std::string>("--record-format");
+  if (format.empty()) {
+    format = std::filesystem::path(this->record_file).extension().string();
+    if (!format.empty()) {
+      Recorder::parse_format(format.substr(1), this->record_format);
+    }
+  } else if (!Recorder::parse_format(format, this->record_format)) {
+    nhlog_error("Unknown record format %s.", format.c_str());
+    exit(EXIT_FAILURE);
+  }
+
+  this->mute = program.get<bool>("--mute");
+  this->latency = program.get<bool>("--latency");
+  this->audio_buffer = std::clamp(program.get<int>("--audio-buffer"), 16, 8192);
+  this->debug = program.get<bool>("--debug");
+  this->gdb_port = std::clamp(program.get<int>("--gdb"), 0, 65535);
+
+  if (this->debug && this->gdb_port != 0) {
+    nhlog_error("--debug and --gdb can't be used together.");
+    exit(EXIT_FAILURE);
+  }
+
+  this->vsync = program.get<bool>("--vsync");
+
+  auto filter = program.get<std::string>("--filter");
+  if (!FrameFilter::parse_mode(filter, this->filter)) {
+    nhlog_error("Unknown filter %s, expected none, decay or or.",
+                filter.c_str());
+    exit(EXIT_FAILURE);
+  }
+  this->decay = std::clamp(program.get<double>("--decay"), 0.0, 1.0);
+  this->filter_frames = std::clamp(program.get<int>("--filter-frames"), 1, 255);
+
+  this->grid_cols = 0;
+  this->grid_rows = 0;
+  auto grid = program.get<std::string>("--grid");
+  if (!grid.empty()) {
+    if (!GridViewer::parse_grid(grid, this->grid_cols, this->grid_rows)) {
+      nhlog_error("Invalid grid %s, expected COLSxROWS.", grid.c_str());
+      exit(EXIT_FAILURE);
+    }
+    if (this->headless || this->debug || this->gdb_port != 0 ||
+        !this->record_file.empty() || !this->record_input.empty() ||
+        !this->play_input.empty()) {
+      nhlog_error("--grid can't be used with --headless, --debug, --gdb, "
+                  "--record or input movies.");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  this->farm = std::max(program.get<int>("--farm"), 0);
+  this->threads = std::max(program.get<int>("--threads"), 0);
+  if (this->threads == 0) {
+    this->threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  if (this->farm != 0) {
+    this->threads = std::min(this->threads, this->farm);
+    if (this->frames == 0) {
+      nhlog_error("--farm requires --frames.");
+      exit(EXIT_FAILURE);
+    }
+    if (this->grid_cols != 0 || this->debug || this->gdb_port != 0 ||
+        !this->record_file.empty() || !this->record_input.empty() ||
+        !this->play_input.empty()) {
+      nhlog_error("--farm can't be used with --grid, --debug, --gdb, "
+                  "--record or input movies.");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  this->metrics = program.get<std::string>("--metrics");
+  this->metrics_interval =
+      std::max(program.get<double>("--metrics-interval"), 0.01);
+  if (!this->metrics.empty() && !this->headless && this->farm == 0) {
+    nhlog_error("--metrics requires --headless or --farm.");
+    exit(EXIT_FAILURE);
+  }
+
+  this->stream = program.get<std::string>("--stream");
+  this->stream_instance = std::max(program.get<int>("--stream-instance"), 0);
+  if (!this->stream.empty() && !this->headless && this->farm == 0) {
+    nhlog_error("--stream requires --headless or --farm.");
+    exit(EXIT_FAILURE);
+  }
+  if (this->farm != 0 && this->stream_instance >= this->farm) {
+    nhlog_error("--stream-instance must be below --farm.");
+    exit(EXIT_FAILURE);
+  }
+
+  nhlog_info("filename=%s, delay=%d, scale=%d, ipf=%u, headless=%d",
+             raw_filename.c_str(), this->delay, this->scale, this->ipf,
+             this->headless);
+}
+
+/*
+ * Draws the end to end latency of recent key presses, one bar per press.
+ */
+static void draw_latency_overlay(Platform &platform,
+                                 const LatencyTracker &latency) {
+  const int size = 2;
+  const int bar_width = 4 * size;
+  const int height = 50 * size;
+  const int width = LatencyTracker::RECENT * bar_width;
+
+  platform.fill_rect(0, 0, width + 4 * size, height + 16 * size, 0x000000C0);
+
+  char text[64];
+  std::snprintf(text, sizeof(text), "IN>PHOTON P50 %.1fMS P99 %.1fMS",
+                latency.to_present.percentile(0.5) / 1000.0,
+                latency.to_present.percentile(0.99) / 1000.0);
+  platform.draw_text(2 * size, 2 * size, size, 0xFFFFFFFF, text);
+
+  // bars are 1 pixel per ms, with a line at 2 frames.
+  int base = height + 14 * size;
+  platform.fill_rect(0, base - 33 * size, width, 1, 0xFF4040FF);
+
+  size_t count = std::min(latency.recent_count, LatencyTracker::RECENT);
+  for (size_t i = 0; i < count; i++) {
+    size_t slot = (latency.recent_count - count + i) % LatencyTracker::RECENT;
+    int ms = std::min<int64_t>(latency.recent[slot] / 1000, 50);
+    platform.fill_rect(2 * size + i * bar_width, base - ms * size,
+                       bar_width - 1, ms * size, 0x40FF40FF);
+  }
+}
+
+/*
+ * Draws the performance counters and a graph of recent frame times in the
+ * top right corner.
+ */
+static void draw_perf_overlay(Platform &platform, const PerfCounters &perf) {
+  const int size = 2;
+  const int line = 7 * size;
+  const int graph_height = 40 * size;
+  const int width = PerfCounters::HISTORY * size + 4 * size;
+  const int x = platform.output_width() - width;
+
+  platform.fill_rect(x, 0, width, 6 * line + graph_height + 4 * size,
+                     0x000000C0);
+
+  auto ms = [](const std::atomic<int64_t> &us) {
+    return us.load(std::memory_order_relaxed) / 1000.0;
+  };
+
+  char text[64];
+  int y = 2 * size;
+  std::snprintf(text, sizeof(text), "IPS %.2fM IPF %u",
+                perf.instructions_per_second.load(std::memory_order_relaxed) /
+                    1e6,
+                perf.ipf.load(std::memory_order_relaxed));
+  platform.draw_text(x + 2 * size, y, size, 0xFFFFFFFF, text);
+
+  y += line;
+  std::snprintf(text, sizeof(text), "INPUT %.2fMS EMU %.2fMS",
+                ms(perf.input_us), ms(perf.emulate_us));
+  platform.draw_text(x + 2 * size, y, size, 0xFFFFFFFF, text);
+
+  y += line;
+  std::snprintf(text, sizeof(text), "PRESENT %.2fMS", ms(perf.present_us));
+  platform.draw_text(x + 2 * size, y, size, 0xFFFFFFFF, text);
+
+  y += line;
+  std::snprintf(text, sizeof(text), "DXYN %.1f%% OF INSTRUCTIONS",
+                perf.draw_share.load(std::memory_order_relaxed) * 100.0);
+  platform.draw_text(x + 2 * size, y, size, 0xFFFFFFFF, text);
+
+  y += line;
+  std::snprintf(text, sizeof(text), "IDLE SKIPS %llu %.0f%% SKIPPED",
+                (unsigned long long)perf.idle_skips.load(
+                    std::memory_order_relaxed),
+                perf.skip_share.load(std::memory_order_relaxed) * 100.0);
+  platform.draw_text(x + 2 * size, y, size, 0xFFFFFFFF, text);
+
+  y += line;
+  std::snprintf(text, sizeof(text), "AUDIO BUFFER %.0f%%",
+                perf.audio_fill.load(std::memory_order_relaxed) * 100.0);
+  platform.draw_text(x + 2 * size, y, size, 0xFFFFFFFF, text);
+
+  // frame times, 1 pixel per ms up to 40ms with a line at 60Hz, oldest on
+  // the left.
+  int base = y + line + graph_height;
+  platform.fill_rect(x + 2 * size, base - 17 * size,
+                     PerfCounters::HISTORY * size, 1, 0xFF4040FF);
+
+  uint64_t frames = perf.frames.load(std::memory_order_acquire);
+  size_t count = std::min<uint64_t>(frames, PerfCounters::HISTORY);
+  for (size_t i = 0; i < count; i++) {
+    size_t slot = (frames - count + i) % PerfCounters::HISTORY;
+    int64_t us = perf.frame_us[slot].load(std::memory_order_relaxed);
+    int height = std::min<int64_t>(us * size / 1000, graph_height);
+    uint32_t color = us > 17500 ? 0xFFC040FF : 0x40FF40FF;
+    platform.fill_rect(x + 2 * size + i * size, base - height, size, height,
+                       color);
+  }
+}
+
+/*
+ * Runs a frame with the debugger hooks only when one is attached, so the
+ * check costs a branch per frame rather than per instruction.
+ */
+static void run_frame(Chip8 &chip8, unsigned int ipf, Debugger *debugger) {
+  if (debugger) {
+    chip8.RunFrame(ipf, *debugger);
+  } else {
+    chip8.RunFrame(ipf);
+  }
+}
+
+/*
+ * Debugger requested on the command line, if any.
+ */
+static std::unique_ptr<Debugger> make_debugger(bool debug, int gdb_port) {
+  if (gdb_port != 0) {
+    return std::make_unique<Debugger>(Debugger::Frontend::GDB, gdb_port);
+  }
+  if (debug) {
+    return std::make_unique<Debugger>(Debugger::Frontend::TERMINAL);
+  }
+  return nullptr;
+}
+
+Chip8 App::make_machine() {
+  Chip8 chip8 = Chip8(this->filename);
+  if (!this->play_input.empty() && chip8.state_hash() != this->movie.rom_hash) {
+    nhlog_warn("%s was recorded with a different rom.",
+               this->play_input.c_str());
+  }
+  if (!this->record_input.empty()) {
+    this->movie.rom_hash = chip8.state_hash();
+  }
+  if (this->seeded) {
+    chip8.seed(this->seed);
+  }
+  chip8.set_memory_policy(this->memory_policy);
+  chip8.set_stack_policy(this->stack_policy);
+  chip8.set_timing(this->timing);
+  return chip8;
+}
+
+uint64_t App::first_seed() const { return this->seeded ? this->seed : 0; }
+
+uint16_t App::next_keypad(uint16_t live) {
+  if (!this->play_input.empty() && !this->movie.finished()) {
+    return this->movie.next();
+  }
+  if (!this->record_input.empty()) {
+    this->movie.record(live);
+  }
+  return live;
 }
 
 // public driver
 int App::run() {
-  Chip8 chip8 = Chip8(this->filename);
-  Platform platform = Platform("cipi8 - A Chip8 Emulator.", VIDEO_WIDTH * scale,
-                               VIDEO_HEIGHT * scale, VIDEO_WIDTH, VIDEO_HEIGHT);
+  if (this->farm != 0) {
+    return this->run_farm();
+  }
+  if (this->grid_cols != 0) {
+    GridViewer grid =
+        GridViewer(this->make_machine(), this->first_seed(), this->grid_cols,
+                   this->grid_rows, this->ipf, this->scale);
+    return grid.run(this->frames);
+  }
+  if (this->headless) {
+    return this->run_headless();
+  }
+  return this->run_windowed();
+}
 
-  int pitch = sizeof(chip8.display[0]) * VIDEO_WIDTH;
-  auto last_cycle_time = std::chrono::high_resolution_clock::now();
-  bool quit = false;
+int App::run_windowed() {
+  Platform platform =
+      Platform("cipi8 - A Chip8 Emulator.", VIDEO_WIDTH * scale,
+               VIDEO_HEIGHT * scale, VIDEO_WIDTH, VIDEO_HEIGHT, this->vsync);
 
-  while (!quit) {
-    quit = platform.process_input(chip8.keypad);
-    auto current_time = std::chrono::high_resolution_clock::now();
-    float delta_time =
-        std::chrono::duration<float, std::chrono::milliseconds::period>(
-            current_time - last_cycle_time)
-            .count();
+  // drop frames rather than stall emulation when the encoder falls behind.
+  std::unique_ptr<Recorder> recorder;
+  if (!this->record_file.empty()) {
+    recorder = std::make_unique<Recorder>(this->record_file,
+                                          this->record_format, false);
+  }
+
+  // declared after platform so it is closed before SDL quits.
+  std::unique_ptr<Audio> audio;
+  if (!this->mute) {
+    audio = std::make_unique<Audio>(this->audio_buffer);
+  }
+
+  std::unique_ptr<LatencyTracker> latency;
+  if (this->latency) {
+    latency = std::make_unique<LatencyTracker>();
+    platform.set_key_down_listener(
+        [&latency](uint8_t key) { latency->key_down(key); });
+    platform.add_overlay(SDLK_F1, true, [&latency](Platform &platform) {
+      draw_latency_overlay(platform, *latency);
+    });
+  }
+
+  Shared shared;
+  platform.add_overlay(SDLK_F2, false, [&shared](Platform &platform) {
+    draw_perf_overlay(platform, shared.perf);
+  });
+
+  std::thread emulation(&App::emulate, this, std::ref(shared), audio.get(),
+                        recorder.get());
 
-    if (delta_time > this->delay) {
-      last_cycle_time = current_time;
-      chip8.Cycle();
-      platform.update(chip8.display, pitch);
+  int pitch = sizeof(Frame::display[0]) * VIDEO_WIDTH;
+  uint8_t keys[16]{};
+
+  // totals of the last frame handed to the latency tracker.
+  uint32_t seen_key_reads[16]{};
+  uint64_t seen_draws = 0;
+
+  while (!shared.quit.load(std::memory_order_relaxed)) {
+    auto input_start = PerfCounters::Clock::now();
+    if (platform.process_input(keys)) {
+      shared.quit.store(true, std::memory_order_relaxed);
+    }
+
+    uint16_t mask = 0;
+    for (int key = 0; key < 16; key++) {
+      mask |= (keys[key] ? 1u : 0u) << key;
+    }
+    shared.keypad.store(mask, std::memory_order_relaxed);
+    shared.perf.input(
+        PerfCounters::us_between(input_start, PerfCounters::Clock::now()));
+
+    // without vsync only new frames are presented, with it every refresh
+    // is and present() does the waiting.
+    bool fresh = shared.frames.update();
+    if (!fresh && !this->vsync) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    const Frame &frame = shared.frames.front();
+    if (latency && fresh) {
+      uint16_t keys_read = 0;
+      for (int key = 0; key < 16; key++) {
+        keys_read |= (frame.key_reads[key] != seen_key_reads[key]) << key;
+      }
+      latency->frame_executed(keys_read, frame.draws != seen_draws);
+      std::memcpy(seen_key_reads, frame.key_reads, sizeof(seen_key_reads));
+      seen_draws = frame.draws;
+    }
+
+    auto present_start = PerfCounters::Clock::now();
+    platform.update(frame.display, pitch);
+    shared.perf.presented(
+        PerfCounters::us_between(present_start, PerfCounters::Clock::now()));
+    if (latency) {
+      latency->presented();
     }
   }
 
+  emulation.join();
+
+  if (latency) {
+    std::cout << latency->report();
+  }
+
+  return EXIT_SUCCESS;
+}
+
+void App::emulate(Shared &shared, Audio *audio, Recorder *recorder) {
+  Chip8 chip8 = this->make_machine();
+
+  // created here, a stopped debugger only blocks this thread.
+  std::unique_ptr<Debugger> debugger =
+      make_debugger(this->debug, this->gdb_port);
+
+  const auto frame_time =
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(1.0 / 60.0));
+
+  // filtered here rather than on the render thread, so it sees every
+  // frame, including those the window drops.
+  FrameFilter filter(this->filter, this->decay, this->filter_frames);
+
+  uint32_t key_reads[16]{};
+  uint64_t draws = 0;
+  auto next_frame_time = std::chrono::steady_clock::now();
+  unsigned int frame = 0;
+  bool trapped = false;
+
+  while (!shared.quit.load(std::memory_order_relaxed)) {
+    chip8.set_keypad_mask(
+        this->next_keypad(shared.keypad.load(std::memory_order_relaxed)));
+    chip8.keys_read = 0;
+    chip8.draw_flag = false;
+
+    auto emulate_start = PerfCounters::Clock::now();
+    run_frame(chip8, this->ipf, debugger.get());
+    shared.perf.frame(chip8.counters, this->ipf,
+                      PerfCounters::us_between(emulate_start,
+                                               PerfCounters::Clock::now()));
+
+    if (audio) {
+      audio->set_tone(chip8.sound_timer > 0);
+      shared.perf.audio(audio->buffer_fill());
+    }
+    if (recorder) {
+      recorder->submit(chip8);
+    }
+
+    for (int key = 0; key < 16; key++) {
+      key_reads[key] += (chip8.keys_read >> key) & 1u;
+    }
+    draws += chip8.draw_flag;
+
+    // the window stays open on the last frame, so it can be looked at.
+    if (chip8.trapped() && !trapped && !debugger) {
+      nhlog_warn("Trapped at pc=%03x.", chip8.pc);
+      trapped = true;
+    }
+
+    Frame &out = shared.frames.back();
+    filter.apply(chip8.display, out.display);
+    std::memcpy(out.key_reads, key_reads, sizeof(key_reads));
+    out.draws = draws;
+    shared.frames.publish();
+
+    if ((debugger && debugger->quit_requested()) ||
+        (this->frames != 0 && ++frame >= this->frames)) {
+      shared.quit.store(true, std::memory_order_relaxed);
+    }
+
+    // don't try to catch up after a long stall.
+    auto current_time = std::chrono::steady_clock::now();
+    next_frame_time += frame_time;
+    if (current_time > next_frame_time + 4 * frame_time) {
+      next_frame_time = current_time + frame_time;
+    }
+    std::this_thread::sleep_until(next_frame_time);
+  }
+
+  if (!this->record_input.empty() && this->movie.save(this->record_input)) {
+    nhlog_info("recorded %u frames of input.", this->movie.frames);
+  }
+}
+
+int App::run_headless() {
+  Chip8 chip8 = this->make_machine();
+
+  // nothing to keep in real time, so never lose a frame.
+  std::unique_ptr<Recorder> recorder;
+  if (!this->record_file.empty()) {
+    recorder = std::make_unique<Recorder>(this->record_file,
+                                          this->record_format, true);
+  }
+
+  std::unique_ptr<Debugger> debugger =
+      make_debugger(this->debug, this->gdb_port);
+
+  std::unique_ptr<Metrics> metrics;
+  if (!this->metrics.empty()) {
+    metrics = std::make_unique<Metrics>(this->metrics, "headless", 1,
+                                        this->metrics_interval);
+  }
+
+  std::unique_ptr<StreamServer> stream;
+  if (!this->stream.empty()) {
+    stream = std::make_unique<StreamServer>(this->stream);
+  }
+
+  auto start_time = std::chrono::high_resolution_clock::now();
+  for (unsigned int frame = 0; frame < this->frames; frame++) {
+    chip8.set_keypad_mask(this->next_keypad(stream ? stream->keypad() : 0));
+    Chip8Counters before = chip8.counters;
+    auto frame_start = MetricsShard::Clock::now();
+    run_frame(chip8, this->ipf, debugger.get());
+    if (metrics) {
+      metrics->shard(0).machine(before, chip8.counters, 1);
+      metrics->shard(0).job(MetricsShard::ns_since(frame_start));
+    }
+    if (debugger && debugger->quit_requested()) {
+      break;
+    }
+    if (recorder) {
+      recorder->submit(chip8);
+    }
+    if (stream) {
+      stream->publish(chip8);
+    }
+    if (chip8.trapped() && !debugger) {
+      nhlog_warn("Trapped at pc=%03x after %u frames.", chip8.pc, frame + 1);
+      break;
+    }
+  }
+
+  auto elapsed = std::chrono::duration<double>(
+                     std::chrono::high_resolution_clock::now() - start_time)
+                     .count();
+  nhlog_info("ran %u frames in %.3fs (%.1f fps).", this->frames, elapsed,
+             this->frames / std::max(elapsed, 1e-9));
+  if (this->timing == Timing::VIP) {
+    nhlog_info("%.0f VIP machine cycles per second, %.1fx a real VIP.",
+               chip8.counters.cycles / std::max(elapsed, 1e-9),
+               this->frames / std::max(elapsed, 1e-9) / 60.0);
+  }
+
+  // runs with the same seed and input end in the same state.
+  nhlog_info("state hash %016llx.", (unsigned long long)chip8.state_hash());
+
+  return EXIT_SUCCESS;
+}
+
+int App::run_farm() {
+  Chip8 initial = this->make_machine();
+  uint64_t first_seed = this->first_seed();
+
+  // machine i is seeded with first_seed + i whichever thread runs it.
+  std::vector<std::unique_ptr<Scheduler>> schedulers;
+  std::unique_ptr<Metrics> metrics;
+  if (!this->metrics.empty()) {
+    metrics = std::make_unique<Metrics>(this->metrics, "farm", this->threads,
+                                        this->metrics_interval);
+  }
+
+  for (unsigned int thread = 0; thread < this->threads; thread++) {
+    size_t capacity = (this->farm - thread + this->threads - 1) / this->threads;
+    schedulers.push_back(
+        std::make_unique<Scheduler>(this->ipf, !this->headless, capacity));
+    if (metrics) {
+      schedulers.back()->set_metrics(&metrics->shard(thread));
+    }
+  }
+
+  // the streamed machine is published by the thread which runs it, and
+  // gets the viewer's keys from the next tick on.
+  std::unique_ptr<StreamServer> stream;
+  if (!this->stream.empty()) {
+    stream = std::make_unique<StreamServer>(this->stream);
+    Scheduler &scheduler = *schedulers[this->stream_instance % this->threads];
+    size_t vm = this->stream_instance / this->threads;
+    scheduler.set_tick_listener(
+        [&stream, &scheduler, vm, keypad = uint16_t(0)]() mutable {
+          stream->publish(scheduler.machine(vm));
+          if (stream->keypad() != keypad) {
+            keypad = stream->keypad();
+            scheduler.set_keypad(vm, keypad);
+          }
+        });
+  }
+
+  auto start_time = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (unsigned int thread = 0; thread < this->threads; thread++) {
+    workers.emplace_back([this, thread, first_seed, &initial, &schedulers]() {
+      // added by the worker itself, so its machines are first touched, and
+      // placed, on its NUMA node.
+      Scheduler &scheduler = *schedulers[thread];
+      for (unsigned int i = thread; i < this->farm; i += this->threads) {
+        Chip8 chip8 = initial;
+        chip8.seed(first_seed + i);
+        scheduler.add(chip8);
+      }
+      scheduler.run(this->frames);
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start_time)
+                       .count();
+
+  uint64_t run = 0, parked = 0;
+  size_t halted = 0;
+  for (std::unique_ptr<Scheduler> &scheduler : schedulers) {
+    run += scheduler->frames_run;
+    parked += scheduler->parked_frames();
+    halted += scheduler->halted;
+  }
+
+  std::printf("%u machines on %u threads for %u frames in %.2fs\n",
+              this->farm, this->threads, this->frames, elapsed);
+  std::printf("frames run: %llu (%.0f/s), parked on key waits: %llu, "
+              "halted machines: %zu\n",
+              (unsigned long long)run, run / std::max(elapsed, 1e-9),
+              (unsigned long long)parked, halted);
+
   return EXIT_SUCCESS;
 }
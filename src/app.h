@@ -1,12 +1,31 @@
 #pragma once
 
+#include "audio.h"
 #include "chip8.h"
+#include "debugger.h"
 #include "external/argparse.hpp"
 #include "external/nhlog.h"
+#include "frame_filter.h"
+#include "frame_stream.h"
+#include "grid_viewer.h"
+#include "input_movie.h"
+#include "latency.h"
+#include "metrics.h"
+#include "perf_counters.h"
 #include "platform.h"
+#include "recorder.h"
+#include "scheduler.h"
+#include "triple_buffer.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <thread>
 
 class App {
 public:
@@ -14,7 +33,143 @@ public:
   int scale;
   int delay;
 
+  // instructions executed per 60Hz frame.
+  unsigned int ipf;
+
+  // run without a window, as fast as possible.
+  bool headless;
+
+  // number of frames to run, 0 runs until the window is closed.
+  unsigned int frames;
+
+  // empty if not recording.
+  std::string record_file;
+  RecordFormat record_format;
+
+  bool mute;
+
+  // audio device buffer size in samples.
+  int audio_buffer;
+
+  // track input to photon latency.
+  bool latency;
+
+  // start paused in the terminal debugger.
+  bool debug;
+
+  // port of the gdb stub, 0 if disabled.
+  int gdb_port;
+
+  // present with vsync, emulation keeps its own 60Hz pacing.
+  bool vsync;
+
+  // anti-flicker post-process of the window.
+  FilterMode filter;
+  double decay;
+  unsigned int filter_frames;
+
+  // size of the instance grid, 0 if not showing a grid.
+  unsigned int grid_cols;
+  unsigned int grid_rows;
+
+  // machines run by the coroutine farm, 0 if not running a farm.
+  unsigned int farm;
+
+  // scheduler threads of the farm.
+  unsigned int threads;
+
+  // what out of range memory accesses and stack use do.
+  AccessPolicy memory_policy;
+  AccessPolicy stack_policy;
+
+  // how frames are paced.
+  Timing timing;
+
+  // seed of the random number generator, if not seeded from the clock.
+  bool seeded;
+  uint64_t seed;
+
+  // input movie files, empty if not recording or playing.
+  std::string record_input;
+  std::string play_input;
+
+  // metrics file or localhost:PORT, empty if not exporting metrics.
+  std::string metrics;
+  double metrics_interval;
+
+  // unix socket the display is streamed on, empty if not streaming, and
+  // the farm instance streamed.
+  std::string stream;
+  unsigned int stream_instance;
+
 public:
   App(int argc, char *argv[]);
   int run();
+
+private:
+  /*
+   * Frame handed from the emulation thread to the render thread.
+   */
+  struct Frame {
+    uint32_t display[VIDEO_WIDTH * VIDEO_HEIGHT];
+
+    // running totals, so the render thread sees reads and draws of frames
+    // it never presented.
+    uint32_t key_reads[16];
+    uint64_t draws;
+  };
+
+  /*
+   * State shared by the emulation and render threads of run_windowed.
+   */
+  struct Shared {
+    TripleBuffer<Frame> frames;
+
+    // keys held in the window, bit n is key n.
+    std::atomic<uint16_t> keypad{0};
+
+    // set by either thread to stop both.
+    std::atomic<bool> quit{false};
+
+    PerfCounters perf;
+  };
+
+  /*
+   * Render thread, polls input and presents the newest frame.
+   */
+  int run_windowed();
+
+  /*
+   * Emulation thread of run_windowed, runs frames at 60Hz until
+   * shared.quit is set.
+   */
+  void emulate(Shared &shared, Audio *audio, Recorder *recorder);
+
+  int run_headless();
+
+  /*
+   * Runs `farm` machines on `threads` coroutine schedulers.
+   */
+  int run_farm();
+
+  /*
+   * Machine with the rom loaded and seeded, checked against the input
+   * movie when playing one.
+   */
+  Chip8 make_machine();
+
+  /*
+   * Seed of the first of many instances, --seed or 0. Instance i gets this
+   * plus i.
+   */
+  uint64_t first_seed() const;
+
+  /*
+   * Keypad mask the next frame runs with, from the movie while one plays,
+   * otherwise `live`, which is recorded if recording.
+   */
+  uint16_t next_keypad(uint16_t live);
+
+private:
+  InputMovie movie;
 };
@@ -0,0 +1,126 @@
+#include "audio.h"
+#include <algorithm>
+
+const int AUDIO_FREQUENCY = 48000;
+const double TONE_FREQUENCY = 440.0;
+const int16_t TONE_AMPLITUDE = 3000;
+
+Audio::Audio(int buffer_samples) {
+  if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+    nhlog_error("Failed to init audio: %s", SDL_GetError());
+    return;
+  }
+
+  SDL_AudioSpec want{};
+  want.freq = AUDIO_FREQUENCY;
+  want.format = AUDIO_S16SYS;
+  want.channels = 1;
+  want.samples = buffer_samples;
+  want.callback = &Audio::callback;
+  want.userdata = this;
+
+  SDL_AudioSpec have{};
+  this->device = SDL_OpenAudioDevice(nullptr, 0, &want, &have,
+                                     SDL_AUDIO_ALLOW_FREQUENCY_CHANGE |
+                                         SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+  if (this->device == 0) {
+    nhlog_error("Failed to open audio device: %s", SDL_GetError());
+    return;
+  }
+
+  this->frequency = have.freq;
+  this->buffer_samples = have.samples;
+  nhlog_info("audio: frequency=%d, buffer=%d samples (%.2fms)", have.freq,
+             have.samples, 1000.0 * have.samples / have.freq);
+
+  SDL_PauseAudioDevice(this->device, 0);
+}
+
+Audio::~Audio() {
+  if (this->device == 0) {
+    return;
+  }
+
+  // waits for a running callback to return.
+  SDL_CloseAudioDevice(this->device);
+  SDL_QuitSubSystem(SDL_INIT_AUDIO);
+
+  if (this->latency_count > 0) {
+    nhlog_info("audio latency: mean=%.2fms, max=%.2fms over %llu events",
+               this->latency_sum_ns / 1e6 / this->latency_count,
+               this->latency_max_ns / 1e6,
+               (unsigned long long)this->latency_count);
+  }
+}
+
+void Audio::set_tone(bool on) {
+  if (on == this->last_sent || this->device == 0) {
+    return;
+  }
+
+  // if the ring is full retry on the next call, the newest state wins.
+  if (this->events.push(Event{on, now_ns()})) {
+    this->last_sent = on;
+  }
+}
+
+float Audio::buffer_fill() const {
+  if (this->device == 0) {
+    return 0.0f;
+  }
+
+  int64_t buffer_ns = (int64_t)this->buffer_samples * 1000000000 /
+                      std::max(this->frequency, 1);
+  int64_t queued_ns =
+      this->drained_ns.load(std::memory_order_relaxed) - now_ns();
+  return std::clamp((float)queued_ns / std::max(buffer_ns, int64_t(1)), 0.0f,
+                    1.0f);
+}
+
+void Audio::callback(void *userdata, Uint8 *stream, int len) {
+  Audio *audio = static_cast<Audio *>(userdata);
+  audio->fill(reinterpret_cast<int16_t *>(stream), len / sizeof(int16_t));
+}
+
+void Audio::fill(int16_t *samples, int count) {
+  // everything sent so far becomes audible at the end of this buffer.
+  int64_t buffer_ns = (int64_t)this->buffer_samples * 1000000000 /
+                      std::max(this->frequency, 1);
+  int64_t now = now_ns();
+
+  // the device plays these samples out from now on.
+  this->drained_ns.store(now + (int64_t)count * 1000000000 /
+                                   std::max(this->frequency, 1),
+                         std::memory_order_relaxed);
+
+  Event event;
+  while (this->events.pop(event)) {
+    this->on = event.on;
+
+    int64_t latency = now - event.sent_ns + buffer_ns;
+    this->latency_count++;
+    this->latency_sum_ns += latency;
+    this->latency_max_ns = std::max(this->latency_max_ns, latency);
+  }
+
+  double step = TONE_FREQUENCY / std::max(this->frequency, 1);
+  for (int i = 0; i < count; i++) {
+    if (this->on) {
+      samples[i] = this->phase < 0.5 ? TONE_AMPLITUDE : -TONE_AMPLITUDE;
+    } else {
+      samples[i] = 0;
+    }
+
+    // keep the phase running while silent so notes start cleanly.
+    this->phase += step;
+    if (this->phase >= 1.0) {
+      this->phase -= 1.0;
+    }
+  }
+}
+
+int64_t Audio::now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
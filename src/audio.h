@@ -0,0 +1,78 @@
+#pragma once
+
+#include "external/nhlog.h"
+#include "platform.h"
+#include "spsc_queue.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/*
+ * Square wave beeper, played while the sound timer is active.
+ *
+ * The emulation thread only sends on/off transitions through a lock-free
+ * ring, the SDL audio callback drains it and keeps the wave phase
+ * continuous, so bursts of transitions while fast forwarding never stall
+ * or click.
+ */
+class Audio {
+public:
+  /*
+   * `buffer_samples` is the device buffer size, smaller is lower latency.
+   */
+  Audio(int buffer_samples);
+
+  /*
+   * Closes the device and logs the measured latency.
+   */
+  ~Audio();
+
+  /*
+   * Called from the emulation thread, cheap when the state didn't change.
+   */
+  void set_tone(bool on);
+
+  /*
+   * Fraction of the device buffer still queued to play, 0 to 1. Estimated
+   * from when the callback last filled it, near 0 the audio underruns.
+   */
+  float buffer_fill() const;
+
+private:
+  struct Event {
+    bool on;
+
+    // steady clock time at which the emulation thread sent the event.
+    int64_t sent_ns;
+  };
+
+  static void callback(void *userdata, Uint8 *stream, int len);
+
+  void fill(int16_t *samples, int count);
+
+  static int64_t now_ns();
+
+private:
+  SDL_AudioDeviceID device{};
+  int frequency{};
+  int buffer_samples{};
+
+  // emulation thread state.
+  bool last_sent = false;
+
+  SpscQueue<Event, 64> events;
+
+  // audio thread state.
+  bool on = false;
+  double phase = 0.0;
+
+  // steady clock time at which the samples of the last callback have all
+  // played.
+  std::atomic<int64_t> drained_ns{0};
+
+  // latency stats, written by the audio thread, read after the device is
+  // closed.
+  uint64_t latency_count = 0;
+  int64_t latency_sum_ns = 0;
+  int64_t latency_max_ns = 0;
+};
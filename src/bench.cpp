@@ -0,0 +1,166 @@
+#include "chip8.h"
+#include "external/argparse.hpp"
+#include "external/nhlog.h"
+#include "paged_snapshot.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+/*
+ * Headless benchmark: interpreter throughput and snapshot memory overhead
+ * for each rom given on the command line.
+ */
+
+struct BenchOptions {
+  unsigned int frames;
+  unsigned int ipf;
+  unsigned int forks;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+/*
+ * Instructions per second of the plain interpreter.
+ */
+static double bench_throughput(const std::string &rom,
+                               const BenchOptions &options) {
+  Chip8 chip8 = Chip8(rom);
+  chip8.seed(1);
+
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned int frame = 0; frame < options.frames; frame++) {
+    chip8.RunFrame(options.ipf);
+  }
+  return (double)options.frames * options.ipf / seconds_since(start);
+}
+
+/*
+ * Speed under Timing::VIP, as a multiple of a real COSMAC VIP.
+ */
+static double bench_vip(const std::string &rom, const BenchOptions &options) {
+  Chip8 chip8 = Chip8(rom);
+  chip8.seed(1);
+  chip8.set_timing(Timing::VIP);
+
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned int frame = 0; frame < options.frames; frame++) {
+    chip8.RunFrame(options.ipf);
+  }
+  return options.frames / seconds_since(start) / 60.0;
+}
+
+/*
+ * Average bytes per snapshot of a rewind buffer holding one snapshot per
+ * frame, each captured against the previous one.
+ */
+static double bench_rewind(const std::string &rom,
+                           const BenchOptions &options) {
+  Chip8 chip8 = Chip8(rom);
+  chip8.seed(1);
+
+  std::vector<std::unique_ptr<PagedSnapshot>> rewind;
+  size_t total = 0;
+  for (unsigned int frame = 0; frame < options.frames; frame++) {
+    chip8.RunFrame(options.ipf);
+    const PagedSnapshot *parent = rewind.empty() ? nullptr : rewind.back().get();
+    rewind.push_back(std::make_unique<PagedSnapshot>(chip8, parent));
+    total += rewind.back()->owned_bytes();
+  }
+  return (double)total / options.frames;
+}
+
+/*
+ * Average bytes per fork when many machines branch off one root snapshot
+ * with different inputs and run a frame each.
+ */
+static double bench_forks(const std::string &rom, const BenchOptions &options) {
+  Chip8 chip8 = Chip8(rom);
+  chip8.seed(1);
+  for (unsigned int frame = 0; frame < 60; frame++) {
+    chip8.RunFrame(options.ipf);
+  }
+
+  PagedSnapshot root(chip8);
+  std::vector<std::unique_ptr<PagedSnapshot>> forks;
+  size_t total = 0;
+  Chip8 fork;
+  for (unsigned int i = 0; i < options.forks; i++) {
+    root.restore(fork);
+    fork.set_keypad_mask(1u << (i % 16));
+    fork.RunFrame(options.ipf);
+    forks.push_back(std::make_unique<PagedSnapshot>(fork, &root));
+    total += forks.back()->owned_bytes();
+  }
+  return (double)total / options.forks;
+}
+
+int main(int argc, char *argv[]) {
+  nhlog_set_level(NHLOG_ERROR);
+
+  argparse::ArgumentParser program("cipi8-bench", "1.0.0");
+  program.add_argument("roms").help("Rom files to benchmark.").remaining();
+  program.add_argument("--frames")
+      .help("Frames to run per rom.")
+      .default_value(6000)
+      .scan<'i', int>();
+
+  program.add_argument("--ipf")
+      .help("Instructions per frame.")
+      .default_value(1000)
+      .scan<'i', int>();
+
+  program.add_argument("--forks")
+      .help("Forks of one root snapshot for the fork overhead test.")
+      .default_value(1000)
+      .scan<'i', int>();
+
+  try {
+    program.parse_args(argc, argv);
+  } catch (const std::exception &err) {
+    std::cerr << "Failed to parse arguments." << err.what() << std::endl;
+    std::cerr << program;
+    std::exit(1);
+  }
+
+  BenchOptions options;
+  options.frames = std::max(program.get<int>("--frames"), 1);
+  options.ipf = std::max(program.get<int>("--ipf"), 1);
+  options.forks = std::max(program.get<int>("--forks"), 1);
+
+  std::vector<std::string> roms;
+  try {
+    roms = program.get<std::vector<std::string>>("roms");
+  } catch (const std::logic_error &) {
+    std::cerr << "No rom files given." << std::endl;
+    std::exit(1);
+  }
+
+  std::printf("%-40s %14s %10s %10s %12s %12s\n", "rom", "instr/s", "vip x",
+              "flat B", "rewind B/f", "fork B");
+  for (const std::string &rom : roms) {
+    if (!std::filesystem::is_regular_file(rom)) {
+      nhlog_error("Skipping %s, not a file.", rom.c_str());
+      continue;
+    }
+
+    std::string name = std::filesystem::path(rom).stem().string();
+    if (name.size() > 40) {
+      name.resize(40);
+    }
+
+    std::printf("%-40s %14.0f %10.0f %10zu %12.1f %12.1f\n", name.c_str(),
+                bench_throughput(rom, options), bench_vip(rom, options),
+                sizeof(Chip8Snapshot),
+                bench_rewind(rom, options), bench_forks(rom, options));
+  }
+
+  return EXIT_SUCCESS;
+}
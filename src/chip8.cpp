@@ -1,7 +1,19 @@
 #include "chip8.h"
 #include <cstdint>
 
-Chip8::Chip8(std::string filename)
+// inverse of minstd_rand's multiplier modulo its modulus.
+const uint64_t MINSTD_INVERSE = 1899818559;
+static_assert(std::minstd_rand::multiplier * MINSTD_INVERSE %
+                      std::minstd_rand::modulus ==
+                  1,
+              "MINSTD_INVERSE must invert the minstd_rand multiplier.");
+
+Chip8::Chip8(std::string filename) : Chip8() {
+  // start loading rom into vm memory.
+  this->load_rom(filename);
+}
+
+Chip8::Chip8()
     : rand_generator(
           std::chrono::system_clock::now().time_since_epoch().count()) {
 
@@ -10,9 +22,6 @@ Chip8::Chip8(std::string filename)
     memory[FONT_START_ADDR + i] = FONTSET[i];
   }
 
-  // start loading rom into vm memory.
-  this->load_rom(filename);
-
   // init rng
   this->rand_byte = std::uniform_int_distribution<uint8_t>(0, 255U);
 
@@ -36,7 +45,7 @@ Chip8::Chip8(std::string filename)
 
   // by default make all function pointers in the following
   // table point to OP_NULL.
-  for (size_t i = 0; i <= 0xE; i++) {
+  for (size_t i = 0; i <= 0xF; i++) {
     this->table_0[i] = &Chip8::OP_NULL;
     this->table_8[i] = &Chip8::OP_NULL;
     this->table_E[i] = &Chip8::OP_NULL;
@@ -59,7 +68,7 @@ Chip8::Chip8(std::string filename)
   this->table_E[0x1] = &Chip8::OP_ExA1;
   this->table_E[0xE] = &Chip8::OP_Ex9E;
 
-  for (size_t i = 0; i <= 0x65; i++) {
+  for (size_t i = 0; i <= 0xFF; i++) {
     this->table_F[i] = &Chip8::OP_NULL;
   }
 
@@ -75,16 +84,19 @@ Chip8::Chip8(std::string filename)
 
   // set pc to start of instructions.
   this->pc = 0x200;
+
+  this->rehash();
 }
 
 /*
  * Fetch, Decode, Execute.
  */
-void Chip8::Cycle() {
+void Chip8::Execute() {
   nhlog_trace("pc=%u", this->pc);
 
   // fetch instruction
-  this->opcode = (this->memory[this->pc] << 8u) | this->memory[this->pc + 1];
+  this->opcode = (this->memory[this->address(this->pc, 0)] << 8u) |
+                 this->memory[this->address(this->pc, 1)];
 
   nhlog_trace("opcode=%u", this->opcode);
   nhlog_trace("(this->opcode & 0xF000u) >> 12u=%u",
@@ -95,6 +107,10 @@ void Chip8::Cycle() {
 
   // decode and execute
   ((*this).*(table[(this->opcode & 0xF000u) >> 12u]))();
+}
+
+void Chip8::Cycle() {
+  this->Execute();
 
   // decrement delay and sound timer
   if (this->delay_timer > 0) {
@@ -106,6 +122,231 @@ void Chip8::Cycle() {
   }
 }
 
+void Chip8::Step() {
+  if (this->fault) {
+    return;
+  }
+  this->Cycle();
+  this->counters.instructions++;
+  this->check_traps();
+}
+
+void Chip8::RunFrame(unsigned int ipf) {
+  if (this->fault) {
+    return;
+  }
+  if (this->timing_model == Timing::VIP) {
+    NoHooks hooks;
+    this->RunVipFrame(hooks);
+    return;
+  }
+  this->counters.instructions += ipf;
+
+  for (unsigned int i = 0; i < ipf; i++) {
+    uint16_t pc = this->pc;
+    this->Cycle();
+
+    // only these leave pc in place and repeat identically, a call or
+    // return to itself changes the stack.
+    if (this->pc == pc && ((this->opcode & 0xF000u) == 0x1000u ||
+                           (this->opcode & 0xF0FFu) == 0xF00Au)) {
+      this->skip_idle(ipf - i - 1);
+      break;
+    }
+  }
+
+  this->check_traps();
+}
+
+void Chip8::set_memory_policy(AccessPolicy policy) {
+  // any power of two past the guard works, base and offset never reach it.
+  this->memory_mask =
+      policy == AccessPolicy::WRAP ? MEMORY_SIZE - 1 : 2 * MEMORY_SIZE - 1;
+  this->address_trap_bits =
+      policy == AccessPolicy::WRAP ? 0 : ~(MEMORY_SIZE - 1);
+}
+
+void Chip8::set_stack_policy(AccessPolicy policy) {
+  this->stack_mask = policy == AccessPolicy::WRAP ? 0xF : 0xFF;
+  this->stack_trap_bits = policy == AccessPolicy::WRAP ? 0 : ~0xFu;
+}
+
+bool Chip8::parse_policy(const std::string &name, AccessPolicy &policy) {
+  if (name == "wrap") {
+    policy = AccessPolicy::WRAP;
+  } else if (name == "trap") {
+    policy = AccessPolicy::TRAP;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void Chip8::set_timing(Timing timing) {
+  this->timing_model = timing;
+  this->vip_debt = 0;
+}
+
+bool Chip8::parse_timing(const std::string &name, Timing &timing) {
+  if (name == "instructions") {
+    timing = Timing::INSTRUCTIONS;
+  } else if (name == "vip") {
+    timing = Timing::VIP;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Approximate machine cycles of the VIP interpreter's routines. Every
+ * instruction also pays 40 cycles for the fetch and decode loop, and a
+ * taken skip 4 more.
+ */
+unsigned int Chip8::vip_cycles(uint16_t pc) const {
+  const unsigned int FETCH = 40;
+  const unsigned int SKIP = 4;
+
+  uint8_t x = (this->opcode & 0x0F00u) >> 8u;
+  unsigned int skip = (uint16_t)(this->pc - pc) == 4 ? SKIP : 0;
+
+  switch (this->opcode & 0xF000u) {
+  case 0x0000u:
+    // clearing writes all 256 bytes of the display page.
+    return FETCH + (this->opcode == 0x00E0u ? 3078 : 10);
+  case 0x1000u:
+    return FETCH + 12;
+  case 0x2000u:
+    return FETCH + 26;
+  case 0x3000u:
+  case 0x4000u:
+    return FETCH + 10 + skip;
+  case 0x5000u:
+  case 0x9000u:
+    return FETCH + 14 + skip;
+  case 0x6000u:
+    return FETCH + 6;
+  case 0x7000u:
+    return FETCH + 10;
+  case 0x8000u:
+    return FETCH + 44;
+  case 0xA000u:
+    return FETCH + 12;
+  case 0xB000u:
+    return FETCH + 22;
+  case 0xC000u:
+    return FETCH + 36;
+  case 0xD000u: {
+    // each row is shifted into place a bit at a time, and a row which
+    // isn't byte aligned is written as two bytes.
+    unsigned int shift = this->registers[x] & 7u;
+    unsigned int rows = this->opcode & 0x000Fu;
+    return FETCH + 26 + rows * (34 + 4 * shift + (shift ? 12 : 0));
+  }
+  case 0xE000u:
+    return FETCH + 14 + skip;
+  }
+
+  switch (this->opcode & 0x00FFu) {
+  case 0x33: {
+    // the digits are found by repeated subtraction.
+    uint8_t value = this->registers[x];
+    return FETCH + 84 + 16 * (value / 100 + value / 10 % 10 + value % 10);
+  }
+  case 0x55:
+  case 0x65:
+    return FETCH + 14 + 14 * (x + 1);
+  case 0x0A:
+    return FETCH + 18;
+  case 0x1E:
+  case 0x29:
+    return FETCH + 16;
+  default:
+    return FETCH + 10;
+  }
+}
+
+inline size_t Chip8::address(size_t base, size_t offset) {
+  this->address_bits |= base + offset;
+  return ((base & (MEMORY_SIZE - 1)) + offset) & this->memory_mask;
+}
+
+void Chip8::check_traps() {
+  if (!(this->address_bits & this->address_trap_bits) &&
+      !(this->stack_bits & this->stack_trap_bits)) {
+    return;
+  }
+
+  this->fault = true;
+  nhlog_debug("trapped at pc=%03x, %s.", this->pc,
+              this->stack_bits & this->stack_trap_bits
+                  ? "stack overflow or underflow"
+                  : "memory access out of range");
+}
+
+void Chip8::clear_fault() {
+  std::memset(this->memory + MEMORY_SIZE, 0, MEMORY_GUARD);
+  this->address_bits = 0;
+  this->stack_bits = 0;
+  this->fault = false;
+}
+
+void Chip8::skip_idle(unsigned int cycles) {
+  if (cycles == 0) {
+    return;
+  }
+
+  this->delay_timer =
+      this->delay_timer > cycles ? this->delay_timer - cycles : 0;
+  this->sound_timer =
+      this->sound_timer > cycles ? this->sound_timer - cycles : 0;
+  this->counters.idle_skips++;
+  this->counters.skipped += cycles;
+}
+
+void Chip8::pack_display(uint8_t *out) const {
+  for (size_t i = 0; i < PACKED_DISPLAY_SIZE; i++) {
+    uint8_t byte = 0;
+    for (size_t bit = 0; bit < 8; bit++) {
+      byte = (byte << 1u) | (this->display[i * 8 + bit] & 1u);
+    }
+    out[i] = byte;
+  }
+}
+
+void Chip8::set_keypad_mask(uint16_t mask) {
+  for (size_t i = 0; i < 16; i++) {
+    this->keypad[i] = (mask >> i) & 1u;
+  }
+}
+
+void Chip8::seed(uint64_t seed) { this->rand_generator.seed(seed); }
+
+bool Chip8::halted() const {
+  if (this->fault) {
+    return true;
+  }
+
+  uint16_t next = (this->memory[this->pc & 0xFFFu] << 8u) |
+                  this->memory[(this->pc + 1) & 0xFFFu];
+  return next == (0x1000u | this->pc);
+}
+
+bool Chip8::waiting_for_key() const {
+  uint16_t next = (this->memory[this->pc & 0xFFFu] << 8u) |
+                  this->memory[(this->pc + 1) & 0xFFFu];
+  if ((next & 0xF0FFu) != 0xF00Au) {
+    return false;
+  }
+
+  for (uint8_t key : this->keypad) {
+    if (key) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void Chip8::load_rom(std::string filename) {
   nhlog_trace("loading rom...");
   // open file
@@ -124,13 +365,133 @@ void Chip8::load_rom(std::string filename) {
   file.close();
 
   // read data from buffer to vm's memory
-  for (size_t i = 0; i < size; i++) {
-    this->memory[ROM_START_ADDR + i] = buffer[i];
+  if (!this->load_rom(reinterpret_cast<const uint8_t *>(buffer.get()),
+                      size)) {
+    nhlog_error("Rom is too large, only the first %zu bytes were loaded.",
+                MAX_ROM_SIZE);
   }
 
   nhlog_trace("loaded rom into memory.");
 }
 
+bool Chip8::load_rom(const uint8_t *data, size_t size) {
+  bool fits = size <= MAX_ROM_SIZE;
+  if (!fits) {
+    size = MAX_ROM_SIZE;
+  }
+
+  std::memcpy(this->memory + ROM_START_ADDR, data, size);
+  this->rehash();
+  return fits;
+}
+
+void Chip8::save(Chip8Snapshot &snapshot) const {
+  std::memcpy(snapshot.registers, this->registers, sizeof(this->registers));
+  std::memcpy(snapshot.memory, this->memory, sizeof(snapshot.memory));
+  std::memcpy(snapshot.stack, this->stack, sizeof(this->stack));
+  std::memcpy(snapshot.keypad, this->keypad, sizeof(this->keypad));
+  snapshot.index = this->index;
+  snapshot.pc = this->pc;
+  snapshot.sp = this->sp;
+  snapshot.delay_timer = this->delay_timer;
+  snapshot.sound_timer = this->sound_timer;
+  this->pack_display(snapshot.display);
+
+  // minstd_rand only streams its state as text. Its next value is the
+  // state times the multiplier, so the state is that over the multiplier.
+  std::minstd_rand next = this->rand_generator;
+  snapshot.rand_state =
+      (uint64_t)next() * MINSTD_INVERSE % std::minstd_rand::modulus;
+}
+
+void Chip8::restore(const Chip8Snapshot &snapshot) {
+  this->clear_fault();
+  std::memcpy(this->registers, snapshot.registers, sizeof(this->registers));
+  std::memcpy(this->memory, snapshot.memory, sizeof(snapshot.memory));
+  std::memcpy(this->stack, snapshot.stack, sizeof(this->stack));
+  std::memcpy(this->keypad, snapshot.keypad, sizeof(this->keypad));
+  this->index = snapshot.index;
+  this->pc = snapshot.pc;
+  this->sp = snapshot.sp;
+  this->delay_timer = snapshot.delay_timer;
+  this->sound_timer = snapshot.sound_timer;
+  this->rand_generator.seed(snapshot.rand_state);
+
+  for (size_t i = 0; i < VIDEO_WIDTH * VIDEO_HEIGHT; i++) {
+    bool on = snapshot.display[i / 8] & (0x80u >> (i % 8));
+    this->display[i] = on ? 0xFFFFFFFF : 0;
+  }
+
+  this->rehash();
+}
+
+// splitmix64 finalizer.
+static inline uint64_t mix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30u)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27u)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31u);
+}
+
+inline uint64_t Chip8::memory_key(size_t address, uint8_t value) {
+  return value ? mix64((address << 8u) | value) : 0;
+}
+
+inline uint64_t Chip8::pixel_key(size_t pixel) {
+  return mix64(0x100000000ull | pixel);
+}
+
+inline void Chip8::write_memory(size_t address, uint8_t value) {
+  // the guard only holds what a trapped access left until clear_fault(),
+  // snapshots skip it, so the hash does too.
+  if (address >= MEMORY_SIZE) {
+    this->memory[address] = value;
+    return;
+  }
+
+  this->memory_hash ^=
+      memory_key(address, this->memory[address]) ^ memory_key(address, value);
+  this->memory[address] = value;
+  this->dirty_pages |= 1u << ((address / MEMORY_PAGE_SIZE) & 0xFu);
+}
+
+uint64_t Chip8::state_hash() const {
+  // the small parts of the state are cheap enough to fold in every time.
+  uint64_t hash = mix64(this->memory_hash ^ mix64(this->display_hash));
+  uint64_t word = 0;
+  for (size_t i = 0; i < 16; i += 8) {
+    std::memcpy(&word, this->registers + i, 8);
+    hash = mix64(hash ^ word);
+  }
+  for (size_t i = 0; i < 16; i += 4) {
+    std::memcpy(&word, this->stack + i, 8);
+    hash = mix64(hash ^ word);
+  }
+
+  word = (uint64_t)this->index | (uint64_t)this->pc << 16u |
+         (uint64_t)this->sp << 32u | (uint64_t)this->delay_timer << 40u |
+         (uint64_t)this->sound_timer << 48u;
+  return mix64(hash ^ word);
+}
+
+void Chip8::rehash() {
+  this->snapshot_id = 0;
+  this->dirty_pages = 0xFFFFu;
+  this->dirty_rows = 0xFFFFFFFFu;
+
+  this->memory_hash = 0;
+  for (size_t i = 0; i < MEMORY_SIZE; i++) {
+    this->memory_hash ^= memory_key(i, this->memory[i]);
+  }
+
+  this->display_hash = 0;
+  for (size_t i = 0; i < VIDEO_WIDTH * VIDEO_HEIGHT; i++) {
+    if (this->display[i]) {
+      this->display_hash ^= pixel_key(i);
+    }
+  }
+}
+
 /*
  * Functions corresponding to each instruction table
  */
@@ -157,14 +518,19 @@ inline void Chip8::Table_F() { ((*this).*(table_F[this->opcode & 0x00FFu]))(); }
  */
 inline void Chip8::OP_00E0() {
   std::memset(this->display, 0, sizeof(this->display));
+  this->display_hash = 0;
+  this->dirty_rows = 0xFFFFFFFFu;
+  this->draw_flag = true;
 }
 
 /*
  * returns from a subroutine
  */
 inline void Chip8::OP_00EE() {
-  --this->sp;
-  this->pc = this->stack[sp];
+  // under TRAP an empty stack underflows to 0xFF.
+  this->sp = (this->sp - 1) & this->stack_mask;
+  this->stack_bits |= this->sp;
+  this->pc = this->stack[this->sp & 0xFu];
 }
 
 /*
@@ -180,8 +546,10 @@ inline void Chip8::OP_1nnn() {
  */
 inline void Chip8::OP_2nnn() {
   uint16_t address = this->opcode & 0x0FFFu;
-  this->stack[this->sp] = this->pc;
-  ++this->sp;
+  // 16 entries fit, under TRAP a call with sp at 16 overflows.
+  this->stack_bits |= this->sp;
+  this->stack[this->sp & 0xFu] = this->pc;
+  this->sp = (this->sp + 1) & this->stack_mask;
   this->pc = address;
 }
 
@@ -384,13 +752,20 @@ inline void Chip8::OP_Dxyn() {
   uint8_t yPos = this->registers[Vy] % VIDEO_HEIGHT;
 
   this->registers[0xF] = 0;
+  this->draw_flag = true;
+  this->counters.draws++;
 
   for (size_t row = 0; row < height; ++row) {
-    uint8_t sprite_byte = this->memory[index + row];
+    uint8_t sprite_byte = this->memory[this->address(this->index, row)];
+
+    // sprites wrap around the edges of the screen.
+    size_t y = (yPos + row) % VIDEO_HEIGHT;
+    this->dirty_rows |= 1u << y;
+
     for (size_t col = 0; col < 8; ++col) {
       uint8_t sprite_pixel = sprite_byte & (0x80u >> col);
-      uint32_t *screen_pixel =
-          &this->display[(yPos + row) * VIDEO_WIDTH + (xPos + col)];
+      size_t pixel = y * VIDEO_WIDTH + (xPos + col) % VIDEO_WIDTH;
+      uint32_t *screen_pixel = &this->display[pixel];
 
       // if pixel is on
       if (sprite_pixel) {
@@ -401,6 +776,7 @@ inline void Chip8::OP_Dxyn() {
 
         // XOR with the sprite pixel
         *screen_pixel ^= 0xFFFFFFFF;
+        this->display_hash ^= pixel_key(pixel);
       }
     }
   }
@@ -412,7 +788,8 @@ inline void Chip8::OP_Dxyn() {
 inline void Chip8::OP_Ex9E() {
   uint8_t Vx = (this->opcode & 0x0F00u) >> 8u;
   uint8_t key = this->registers[Vx];
-  if (this->keypad[key]) {
+  this->keys_read |= 1u << (key & 0xFu);
+  if (this->keypad[key & 0xFu]) {
     pc += 2;
   }
 }
@@ -423,7 +800,8 @@ inline void Chip8::OP_Ex9E() {
 inline void Chip8::OP_ExA1() {
   uint8_t Vx = (this->opcode & 0x0F00u) >> 8u;
   uint8_t key = this->registers[Vx];
-  if (!this->keypad[key]) {
+  this->keys_read |= 1u << (key & 0xFu);
+  if (!this->keypad[key & 0xFu]) {
     pc += 2;
   }
 }
@@ -441,6 +819,7 @@ inline void Chip8::OP_Fx07() {
  */
 inline void Chip8::OP_Fx0A() {
   uint8_t Vx = (this->opcode & 0x0F00u) >> 8u;
+  this->keys_read = 0xFFFFu;
   if (this->keypad[0]) {
     this->registers[Vx] = 0;
   } else if (this->keypad[1]) {
@@ -518,13 +897,13 @@ inline void Chip8::OP_Fx33() {
   uint8_t Vx = (this->opcode & 0x0F00u) >> 8u;
   uint8_t value = this->registers[Vx];
 
-  this->memory[index + 2] = value % 10;
+  this->write_memory(this->address(this->index, 2), value % 10);
   value /= 10;
 
-  this->memory[index + 1] = value % 10;
+  this->write_memory(this->address(this->index, 1), value % 10);
   value /= 10;
 
-  this->memory[index] = value % 10;
+  this->write_memory(this->address(this->index, 0), value % 10);
 }
 
 /*
@@ -533,7 +912,7 @@ inline void Chip8::OP_Fx33() {
 inline void Chip8::OP_Fx55() {
   uint8_t Vx = (this->opcode & 0x0F00u) >> 8u;
   for (uint8_t i = 0; i <= Vx; ++i) {
-    this->memory[this->index + i] = this->registers[i];
+    this->write_memory(this->address(this->index, i), this->registers[i]);
   }
 }
 
@@ -543,7 +922,7 @@ inline void Chip8::OP_Fx55() {
 inline void Chip8::OP_Fx65() {
   uint8_t Vx = (this->opcode & 0x0F00u) >> 8u;
   for (uint8_t i = 0; i <= Vx; ++i) {
-    this->registers[i] = this->memory[this->index + i];
+    this->registers[i] = this->memory[this->address(this->index, i)];
   }
 }
 
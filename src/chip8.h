@@ -15,6 +15,26 @@ const size_t FONT_START_ADDR = 0x50;
 const size_t VIDEO_WIDTH = 64;
 const size_t VIDEO_HEIGHT = 32;
 
+// addressable memory, and the bytes after it which accesses running past
+// the end land in under AccessPolicy::TRAP.
+const size_t MEMORY_SIZE = 4096;
+const size_t MEMORY_GUARD = 16;
+
+// largest rom that fits between ROM_START_ADDR and the end of memory.
+const size_t MAX_ROM_SIZE = MEMORY_SIZE - ROM_START_ADDR;
+
+// size of the display when packed at 1 bit per pixel.
+const size_t PACKED_DISPLAY_SIZE = VIDEO_WIDTH * VIDEO_HEIGHT / 8;
+
+// granularity of memory write tracking, see PagedSnapshot.
+const size_t MEMORY_PAGE_SIZE = 256;
+const size_t MEMORY_PAGES = MEMORY_SIZE / MEMORY_PAGE_SIZE;
+
+// COSMAC VIP timing: the 1802 runs 3668 machine cycles of 8 clocks at
+// 1.76064MHz per 60Hz frame. The 1861 display DMA steals 1024 of them and
+// the interrupt routine 46, the interpreter gets the rest.
+const unsigned int VIP_FRAME_CYCLES = 3668 - 1024 - 46;
+
 const unsigned int FONTSET_SIZE = 80;
 const uint8_t FONTSET[FONTSET_SIZE] = {
     0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -35,28 +55,218 @@ const uint8_t FONTSET[FONTSET_SIZE] = {
     0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
+/*
+ * Complete machine state, trivially copyable so it can be stored as raw
+ * bytes. The display is packed at 1 bit per pixel.
+ */
+struct Chip8Snapshot {
+  uint8_t registers[16];
+  uint8_t memory[MEMORY_SIZE];
+  uint16_t index;
+  uint16_t pc;
+  uint16_t stack[16];
+  uint8_t sp;
+  uint8_t delay_timer;
+  uint8_t sound_timer;
+  uint8_t keypad[16];
+  uint8_t display[PACKED_DISPLAY_SIZE];
+  // state of the random generator, the value it returned last.
+  uint32_t rand_state;
+};
+
+/*
+ * Running totals kept by the core for profiling. Not part of the machine
+ * state, so they are neither saved nor hashed.
+ */
+struct Chip8Counters {
+  // instructions emulated, including the ones idle skipping left out.
+  uint64_t instructions;
+
+  // Dxyn instructions executed.
+  uint64_t draws;
+
+  // frames cut short by idle skipping, and the instructions they left out.
+  uint64_t idle_skips;
+  uint64_t skipped;
+
+  // VIP machine cycles charged, only counted under Timing::VIP.
+  uint64_t cycles;
+};
+
+/*
+ * What happens to a memory access past the end of memory, or a call with
+ * the stack full and a return with it empty. WRAP wraps the address or
+ * stack pointer around like most interpreters, TRAP stops the machine at
+ * the end of the frame, see Chip8::trapped().
+ */
+enum class AccessPolicy { WRAP, TRAP };
+
+/*
+ * How frames are paced. INSTRUCTIONS runs ipf instructions of equal weight
+ * per frame and ticks the timers every instruction. VIP charges every
+ * instruction its COSMAC VIP machine cycles and runs VIP_FRAME_CYCLES per
+ * frame, Dxyn waits for the display interrupt like the VIP interpreter and
+ * the timers tick once per frame.
+ */
+enum class Timing { INSTRUCTIONS, VIP };
+
 class Chip8 {
 public:
   uint8_t registers[16]{};
-  uint8_t memory[4096]{};
+  uint8_t memory[MEMORY_SIZE + MEMORY_GUARD]{};
   uint16_t index{};
   uint16_t pc{};
-  uint16_t stack[16];
+  uint16_t stack[16]{};
   uint8_t sp{};
   uint8_t delay_timer{};
   uint8_t sound_timer{};
   uint8_t keypad[16]{};
   uint32_t display[64 * 32]{};
-  uint16_t opcode;
+  uint16_t opcode{};
+
+  // mask of keys read by Ex9E, ExA1 and Fx0A, cleared by the caller.
+  uint16_t keys_read{};
+
+  // set by instructions which change the display, cleared by the caller.
+  bool draw_flag{};
+
+  Chip8Counters counters{};
 
 public:
   Chip8(std::string filename);
 
+  /*
+   * Machine with fonts loaded and no rom.
+   */
+  Chip8();
+
+  /*
+   * Copies a rom from memory into the vm's memory, returns false if it
+   * didn't fit and was truncated.
+   */
+  bool load_rom(const uint8_t *data, size_t size);
+
+  /*
+   * Saves and restores the complete machine state.
+   */
+  void save(Chip8Snapshot &snapshot) const;
+  void restore(const Chip8Snapshot &snapshot);
+
   /*
    * Fetch, Decode, Execute.
    */
   void Cycle();
 
+  /*
+   * A single Cycle(), counted and checked against the access policies the
+   * way RunFrame() does. Does nothing once the machine trapped.
+   */
+  void Step();
+
+  /*
+   * Runs one 60Hz frame worth of cycles, `ipf` instructions or under
+   * Timing::VIP a VIP frame of machine cycles.
+   *
+   * A jump to itself or a key wait with no key down would repeat the same
+   * instruction for the rest of the frame, so the frame ends there and only
+   * the timers are advanced for the skipped cycles.
+   */
+  void RunFrame(unsigned int ipf);
+
+  /*
+   * Same as RunFrame, but calls hooks.before_cycle(*this) before every
+   * instruction and ends the frame early when it returns false. Only used
+   * when hooks are attached, so the plain RunFrame stays hook free.
+   */
+  template <typename Hooks> void RunFrame(unsigned int ipf, Hooks &hooks);
+
+  /*
+   * Packs display into 1 bit per pixel rows, msb is the leftmost pixel.
+   * `out` must hold PACKED_DISPLAY_SIZE bytes.
+   */
+  void pack_display(uint8_t *out) const;
+
+  /*
+   * Sets keypad state from a mask, bit n is key n.
+   */
+  void set_keypad_mask(uint16_t mask);
+
+  /*
+   * Reseeds the random number generator used by Cxkk.
+   */
+  void seed(uint64_t seed);
+
+  /*
+   * Sets the policies for out of range memory accesses and stack use. Both
+   * default to WRAP.
+   */
+  void set_memory_policy(AccessPolicy policy);
+  void set_stack_policy(AccessPolicy policy);
+
+  /*
+   * Parses "wrap" or "trap", returns false for anything else.
+   */
+  static bool parse_policy(const std::string &name, AccessPolicy &policy);
+
+  /*
+   * Sets how frames are paced, INSTRUCTIONS by default.
+   */
+  void set_timing(Timing timing);
+  Timing timing() const { return this->timing_model; }
+
+  /*
+   * Parses "instructions" or "vip", returns false for anything else.
+   */
+  static bool parse_timing(const std::string &name, Timing &timing);
+
+  /*
+   * VIP machine cycles the instruction just executed took, given the pc it
+   * was fetched from.
+   */
+  unsigned int vip_cycles(uint16_t pc) const;
+
+  /*
+   * True once an access broke a TRAP policy. Checked at the end of every
+   * frame, so the rest of that frame still ran with the access landing in
+   * the guard bytes or the stack wrapped. A trapped machine doesn't run
+   * anymore until restored.
+   */
+  bool trapped() const { return this->fault; }
+
+  /*
+   * True if the next instruction jumps to itself, the usual way roms stop,
+   * or the machine trapped.
+   */
+  bool halted() const;
+
+  /*
+   * True if the next instruction is Fx0A and no key is down, so nothing
+   * but the timers changes until a key is pressed.
+   */
+  bool waiting_for_key() const;
+
+  /*
+   * Advances the timers as if `cycles` more cycles repeated an idle
+   * instruction, for schedulers which stop running idle machines.
+   */
+  void skip_idle(unsigned int cycles);
+
+  /*
+   * Hash of the machine state: memory, registers, index, pc, stack, timers
+   * and display. Keypad and rng state are not included.
+   *
+   * Memory and display are hashed incrementally as instructions write them,
+   * so this is O(1). Code writing `memory` or `display` directly must call
+   * rehash() afterwards.
+   */
+  uint64_t state_hash() const;
+
+  /*
+   * Recomputes the incremental hashes from scratch and forgets which
+   * memory pages and display rows were written.
+   */
+  void rehash();
+
 private:
   // c++ member function pointer syntax is diabolical
   typedef void (Chip8::*Chip8Func)();
@@ -64,17 +274,19 @@ private:
   // consists the function pointers to simple instructions.
   Chip8Func table[0xF + 1];
 
-  // consists the function pointers to instructions with 0.
-  Chip8Func table_0[0xE + 1];
+  // consists the function pointers to instructions with 0. The sub tables
+  // cover every value of the bits they are indexed with, so illegal opcodes
+  // reach OP_NULL.
+  Chip8Func table_0[0xF + 1];
 
   // consists the function pointers to instructions with 8.
-  Chip8Func table_8[0xE + 1];
+  Chip8Func table_8[0xF + 1];
 
   // consists the function pointers to instructions with E.
-  Chip8Func table_E[0xE + 1];
+  Chip8Func table_E[0xF + 1];
 
   // consists the function pointers to instructions with F.
-  Chip8Func table_F[0x65 + 1];
+  Chip8Func table_F[0xFF + 1];
 
 private:
   /*
@@ -82,6 +294,20 @@ private:
    */
   void load_rom(std::string filename);
 
+  /*
+   * Cycle without the timers.
+   */
+  void Execute();
+
+  /*
+   * RunFrame under Timing::VIP.
+   */
+  template <typename Hooks> void RunVipFrame(Hooks &hooks);
+
+  struct NoHooks {
+    bool before_cycle(Chip8 &) { return true; }
+  };
+
   /*
    * Clears display
    */
@@ -267,7 +493,134 @@ private:
   inline void Table_E();
   inline void Table_F();
 
+  /*
+   * Index of `base + offset` in memory under the memory policy. Out of
+   * range bits are collected in address_bits instead of branched on.
+   */
+  inline size_t address(size_t base, size_t offset);
+
+  /*
+   * Sets `fault` if an access since the last check broke a TRAP policy.
+   */
+  void check_traps();
+
+  /*
+   * Forgets a trap and clears what it left in the guard bytes.
+   */
+  void clear_fault();
+
+  /*
+   * Writes a byte of memory, keeping memory_hash up to date. Guard bytes
+   * are stored but not hashed.
+   */
+  inline void write_memory(size_t address, uint8_t value);
+
+  /*
+   * Zobrist keys for a memory byte and an on pixel, zero is never a key
+   * so empty memory and a clear display hash to 0.
+   */
+  static inline uint64_t memory_key(size_t address, uint8_t value);
+  static inline uint64_t pixel_key(size_t pixel);
+
 private:
-  std::default_random_engine rand_generator;
+  friend class PagedSnapshot;
+
+  std::minstd_rand rand_generator;
+
+  // 0xFFF wraps addresses, a wider mask lets them run into the guard. The
+  // stack pointer is masked the same way.
+  size_t memory_mask = MEMORY_SIZE - 1;
+  uint8_t stack_mask = 0xF;
+
+  // or of every address and stack pointer used since the last check, and
+  // the bits of them which break the policies.
+  size_t address_bits{};
+  unsigned int stack_bits{};
+  size_t address_trap_bits{};
+  unsigned int stack_trap_bits{};
+  bool fault{};
+
+  Timing timing_model = Timing::INSTRUCTIONS;
+
+  // cycles the next VIP frame starts with already spent.
+  unsigned int vip_debt{};
+
+  // memory pages and display rows written since the machine last matched
+  // the paged snapshot `snapshot_id`, 0 if it matches none.
+  uint16_t dirty_pages{};
+  uint32_t dirty_rows{};
+  uint64_t snapshot_id{};
+
+  // xor of memory_key over every non zero byte of memory, the guard left
+  // out.
+  uint64_t memory_hash{};
+
+  // xor of pixel_key over every on pixel.
+  uint64_t display_hash{};
   std::uniform_int_distribution<uint8_t> rand_byte;
 };
+
+template <typename Hooks> void Chip8::RunFrame(unsigned int ipf, Hooks &hooks) {
+  if (this->timing_model == Timing::VIP) {
+    this->RunVipFrame(hooks);
+    return;
+  }
+
+  for (unsigned int i = 0; i < ipf; i++) {
+    // hooks see a trap before the machine stops, checking after every
+    // instruction is fine here.
+    if (!hooks.before_cycle(*this) || this->fault) {
+      return;
+    }
+    this->Step();
+  }
+}
+
+template <typename Hooks> void Chip8::RunVipFrame(Hooks &hooks) {
+  // a draw which waited for this frame, or an instruction which ran past
+  // the end of the last one, is paid for first.
+  unsigned int cycles = this->vip_debt;
+  this->vip_debt = 0;
+
+  while (cycles < VIP_FRAME_CYCLES) {
+    if (!hooks.before_cycle(*this) || this->fault) {
+      return;
+    }
+
+    uint16_t pc = this->pc;
+    this->Execute();
+    unsigned int cost = this->vip_cycles(pc);
+    cycles += cost;
+    this->counters.instructions++;
+    this->counters.cycles += cost;
+
+    // the interpreter waits for the display interrupt before drawing, so
+    // the rest of the frame goes by and the draw is paid in the next one.
+    if ((this->opcode & 0xF000u) == 0xD000u) {
+      this->vip_debt = cost;
+      cycles = VIP_FRAME_CYCLES;
+      break;
+    }
+
+    // the timers don't tick before the frame ends, so the rest of an idle
+    // frame changes nothing.
+    if (this->pc == pc && ((this->opcode & 0xF000u) == 0x1000u ||
+                           (this->opcode & 0xF0FFu) == 0xF00Au)) {
+      unsigned int skipped = (VIP_FRAME_CYCLES - cycles) / cost;
+      this->counters.instructions += skipped;
+      this->counters.idle_skips++;
+      this->counters.skipped += skipped;
+      cycles = VIP_FRAME_CYCLES;
+      break;
+    }
+  }
+  this->vip_debt += cycles - VIP_FRAME_CYCLES;
+
+  if (this->delay_timer > 0) {
+    --this->delay_timer;
+  }
+  if (this->sound_timer > 0) {
+    --this->sound_timer;
+  }
+  this->check_traps();
+}
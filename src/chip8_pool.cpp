@@ -0,0 +1,118 @@
+#include "chip8_pool.h"
+#include "external/nhlog.h"
+#include <algorithm>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static size_t round_up(size_t size, size_t to) {
+  return (size + to - 1) / to * to;
+}
+
+// constructor.
+Chip8Pool::Chip8Pool(size_t capacity, bool huge_pages) : slots(capacity) {
+  size_t size = std::max<size_t>(capacity, 1) * SLOT_SIZE;
+
+#ifndef _WIN32
+#ifdef MAP_HUGETLB
+  // only succeeds if huge pages were reserved, e.g. vm.nr_hugepages.
+  if (huge_pages) {
+    this->mapping_size = round_up(size, HUGE_PAGE_SIZE);
+    this->mapping = mmap(nullptr, this->mapping_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (this->mapping != MAP_FAILED) {
+      this->arena = (uint8_t *)this->mapping;
+      this->kind = Backing::HUGETLB;
+    }
+  }
+#endif
+
+  if (!this->arena) {
+    // transparent huge pages need a 2MB aligned range, so map one extra
+    // huge page of slack to align the arena in.
+    this->mapping_size =
+        huge_pages ? round_up(size, HUGE_PAGE_SIZE) + HUGE_PAGE_SIZE : size;
+    this->mapping = mmap(nullptr, this->mapping_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (this->mapping != MAP_FAILED) {
+      uintptr_t start = (uintptr_t)this->mapping;
+      this->arena = (uint8_t *)(huge_pages ? round_up(start, HUGE_PAGE_SIZE)
+                                           : start);
+      this->kind = Backing::PAGES;
+#ifdef MADV_HUGEPAGE
+      if (huge_pages &&
+          madvise(this->arena, round_up(size, HUGE_PAGE_SIZE),
+                  MADV_HUGEPAGE) == 0) {
+        this->kind = Backing::TRANSPARENT_HUGE_PAGES;
+      }
+#endif
+    } else {
+      this->mapping = nullptr;
+    }
+  }
+#else
+  (void)huge_pages;
+#endif
+
+  if (!this->arena) {
+    this->arena = (uint8_t *)::operator new(size, std::align_val_t(64));
+    this->kind = Backing::HEAP;
+  }
+
+  nhlog_debug("pool of %zu machines, %zu bytes each, backed by %s.", capacity,
+              SLOT_SIZE, backing_name(this->kind));
+}
+
+Chip8Pool::~Chip8Pool() {
+  // machines still acquired are dropped with the arena, they don't own
+  // anything outside of it.
+#ifndef _WIN32
+  if (this->mapping) {
+    munmap(this->mapping, this->mapping_size);
+    return;
+  }
+#endif
+  ::operator delete(this->arena, std::align_val_t(64));
+}
+
+Chip8 *Chip8Pool::acquire(const Chip8 &from) {
+  uint8_t *slot;
+  if (this->free_list) {
+    slot = (uint8_t *)this->free_list;
+    this->free_list = this->free_list->next;
+  } else if (this->fresh < this->slots) {
+    slot = this->arena + this->fresh * SLOT_SIZE;
+    this->fresh++;
+  } else {
+    return nullptr;
+  }
+
+  this->used++;
+  return new (slot) Chip8(from);
+}
+
+void Chip8Pool::release(Chip8 *chip8) {
+  chip8->~Chip8();
+  FreeSlot *slot = new (chip8) FreeSlot;
+  slot->next = this->free_list;
+  this->free_list = slot;
+  this->used--;
+}
+
+const char *Chip8Pool::backing_name(Backing backing) {
+  switch (backing) {
+  case Backing::HUGETLB:
+    return "huge pages";
+  case Backing::TRANSPARENT_HUGE_PAGES:
+    return "transparent huge pages";
+  case Backing::PAGES:
+    return "pages";
+  case Backing::HEAP:
+    return "the heap";
+  }
+  return "";
+}
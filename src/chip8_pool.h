@@ -0,0 +1,65 @@
+#pragma once
+
+#include "chip8.h"
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Fixed capacity arena of machines, laid out contiguously in cache line
+ * aligned slots.
+ *
+ * The arena is mapped with 2MB huge pages when asked and available, first
+ * from the reserved pool and otherwise as transparent huge pages, falling
+ * back to normal pages. Slots are never touched before they are acquired,
+ * so with the kernel's first touch policy a pool filled from a worker
+ * thread lives on that thread's NUMA node.
+ *
+ * acquire() and release() are O(1): released slots go on an intrusive free
+ * list, and fresh slots are taken in order. Not thread safe, each worker
+ * owns its pool.
+ */
+class Chip8Pool {
+public:
+  enum class Backing { HUGETLB, TRANSPARENT_HUGE_PAGES, PAGES, HEAP };
+
+  explicit Chip8Pool(size_t capacity, bool huge_pages = true);
+  ~Chip8Pool();
+
+  Chip8Pool(const Chip8Pool &) = delete;
+  Chip8Pool &operator=(const Chip8Pool &) = delete;
+
+  /*
+   * Copy of `from` in a free slot, nullptr if the pool is full.
+   */
+  Chip8 *acquire(const Chip8 &from);
+
+  /*
+   * Destroys a machine acquired from this pool and frees its slot.
+   */
+  void release(Chip8 *chip8);
+
+  size_t size() const { return this->used; }
+  size_t capacity() const { return this->slots; }
+  Backing backing() const { return this->kind; }
+  static const char *backing_name(Backing backing);
+
+private:
+  struct FreeSlot {
+    FreeSlot *next;
+  };
+
+  // slot size, sizeof(Chip8) rounded up to a cache line.
+  static const size_t SLOT_SIZE = (sizeof(Chip8) + 63) / 64 * 64;
+
+  uint8_t *arena = nullptr;
+  size_t slots;
+  Backing kind = Backing::HEAP;
+
+  // the mapping, which may start before the arena to align it.
+  void *mapping = nullptr;
+  size_t mapping_size = 0;
+
+  FreeSlot *free_list = nullptr;
+  size_t fresh = 0;
+  size_t used = 0;
+};
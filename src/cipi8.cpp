@@ -0,0 +1,128 @@
+#include "cipi8.h"
+#include "chip8.h"
+#include "transposition_table.h"
+#include <new>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable_v<Chip8Snapshot>,
+              "snapshots are handed out as raw bytes.");
+
+struct cipi8 {
+  Chip8 chip8;
+  uint32_t ipf = 10;
+};
+
+uint32_t cipi8_abi_version(void) { return CIPI8_ABI_VERSION; }
+
+cipi8 *cipi8_create(uint64_t seed) {
+#ifndef CIPI8_DEBUG_MODE
+  // keep the core's trace calls quiet, same as the release app.
+  nhlog_set_level(NHLOG_ERROR);
+#endif
+
+  cipi8 *handle = new (std::nothrow) cipi8();
+  if (!handle) {
+    return nullptr;
+  }
+  handle->chip8.seed(seed);
+  return handle;
+}
+
+void cipi8_destroy(cipi8 *handle) { delete handle; }
+
+int cipi8_load_rom(cipi8 *handle, const uint8_t *data, size_t size) {
+  return handle->chip8.load_rom(data, size) ? 0 : -1;
+}
+
+void cipi8_set_ipf(cipi8 *handle, uint32_t ipf) { handle->ipf = ipf; }
+
+void cipi8_set_keypad(cipi8 *handle, uint16_t mask) {
+  handle->chip8.set_keypad_mask(mask);
+}
+
+void cipi8_step_instructions(cipi8 *handle, uint32_t instructions) {
+  for (uint32_t i = 0; i < instructions; i++) {
+    handle->chip8.Step();
+  }
+}
+
+void cipi8_step_frames(cipi8 *handle, uint32_t frames) {
+  for (uint32_t i = 0; i < frames; i++) {
+    handle->chip8.RunFrame(handle->ipf);
+  }
+}
+
+void cipi8_step_many(cipi8 *const *handles, size_t n, uint32_t frames) {
+  for (size_t i = 0; i < n; i++) {
+    cipi8_step_frames(handles[i], frames);
+  }
+}
+
+const uint32_t *cipi8_get_display(const cipi8 *handle) {
+  return handle->chip8.display;
+}
+
+void cipi8_get_display_packed(const cipi8 *handle, uint8_t *out) {
+  handle->chip8.pack_display(out);
+}
+
+const uint8_t *cipi8_get_memory(const cipi8 *handle) {
+  return handle->chip8.memory;
+}
+
+int cipi8_halted(const cipi8 *handle) { return handle->chip8.halted(); }
+
+uint64_t cipi8_state_hash(const cipi8 *handle) {
+  return handle->chip8.state_hash();
+}
+
+struct cipi8_tt {
+  TranspositionTable table;
+};
+
+cipi8_tt *cipi8_tt_create(uint32_t capacity_log2) {
+  if (capacity_log2 > CIPI8_TT_MAX_CAPACITY_LOG2) {
+    return nullptr;
+  }
+  try {
+    return new cipi8_tt{TranspositionTable(capacity_log2)};
+  } catch (const std::bad_alloc &) {
+    return nullptr;
+  }
+}
+
+void cipi8_tt_destroy(cipi8_tt *table) { delete table; }
+
+int cipi8_tt_insert(cipi8_tt *table, uint64_t hash) {
+  return table->table.insert(hash);
+}
+
+int cipi8_tt_contains(const cipi8_tt *table, uint64_t hash) {
+  return table->table.contains(hash);
+}
+
+size_t cipi8_tt_size(const cipi8_tt *table) { return table->table.size(); }
+
+size_t cipi8_snapshot_size(void) { return sizeof(Chip8Snapshot); }
+
+int cipi8_snapshot(const cipi8 *handle, void *buffer, size_t size) {
+  if (size < sizeof(Chip8Snapshot)) {
+    return -1;
+  }
+
+  Chip8Snapshot snapshot;
+  handle->chip8.save(snapshot);
+  std::memcpy(buffer, &snapshot, sizeof(snapshot));
+  return 0;
+}
+
+int cipi8_restore(cipi8 *handle, const void *buffer, size_t size) {
+  if (size < sizeof(Chip8Snapshot)) {
+    return -1;
+  }
+
+  Chip8Snapshot snapshot;
+  std::memcpy(&snapshot, buffer, sizeof(snapshot));
+  handle->chip8.restore(snapshot);
+  return 0;
+}
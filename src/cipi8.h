@@ -0,0 +1,135 @@
+/*
+ * libcipi8, stable C interface for embedding the emulator.
+ *
+ * Every function taking a handle is safe to call concurrently on different
+ * handles. Nothing here allocates except cipi8_create and cipi8_tt_create,
+ * which return NULL when they can't.
+ */
+#ifndef _CIPI8_H_
+#define _CIPI8_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(CIPI8_BUILDING_LIBRARY)
+#define CIPI8_API __declspec(dllexport)
+#else
+#define CIPI8_API __declspec(dllimport)
+#endif
+#else
+#define CIPI8_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bumped whenever a signature or the snapshot layout changes. */
+#define CIPI8_ABI_VERSION 2u
+
+#define CIPI8_VIDEO_WIDTH 64
+#define CIPI8_VIDEO_HEIGHT 32
+#define CIPI8_PACKED_DISPLAY_SIZE 256
+
+typedef struct cipi8 cipi8;
+
+CIPI8_API uint32_t cipi8_abi_version(void);
+
+/*
+ * New machine with fonts loaded and no rom, runs 10 instructions per frame.
+ * NULL if it could not be allocated.
+ */
+CIPI8_API cipi8 *cipi8_create(uint64_t seed);
+CIPI8_API void cipi8_destroy(cipi8 *handle);
+
+/*
+ * Copies a rom into memory at 0x200, returns 0 on success and -1 if it was
+ * too large and got truncated.
+ */
+CIPI8_API int cipi8_load_rom(cipi8 *handle, const uint8_t *data, size_t size);
+
+CIPI8_API void cipi8_set_ipf(cipi8 *handle, uint32_t ipf);
+
+/*
+ * Bit n set means key n is held down.
+ */
+CIPI8_API void cipi8_set_keypad(cipi8 *handle, uint16_t mask);
+
+/*
+ * Runs instructions one at a time, counted and checked like the ones the
+ * frame steps run.
+ */
+CIPI8_API void cipi8_step_instructions(cipi8 *handle, uint32_t instructions);
+CIPI8_API void cipi8_step_frames(cipi8 *handle, uint32_t frames);
+
+/*
+ * Advances `n` machines by `frames` frames each in a single call.
+ */
+CIPI8_API void cipi8_step_many(cipi8 *const *handles, size_t n,
+                               uint32_t frames);
+
+/*
+ * CIPI8_VIDEO_WIDTH * CIPI8_VIDEO_HEIGHT pixels, 0 or 0xFFFFFFFF, valid
+ * until the handle is destroyed.
+ */
+CIPI8_API const uint32_t *cipi8_get_display(const cipi8 *handle);
+
+/*
+ * Writes CIPI8_PACKED_DISPLAY_SIZE bytes, 1 bit per pixel, msb is the
+ * leftmost pixel.
+ */
+CIPI8_API void cipi8_get_display_packed(const cipi8 *handle, uint8_t *out);
+
+/*
+ * Pointer to the 4096 bytes of memory, for reading game state.
+ */
+CIPI8_API const uint8_t *cipi8_get_memory(const cipi8 *handle);
+
+/*
+ * Non zero if the next instruction jumps to itself.
+ */
+CIPI8_API int cipi8_halted(const cipi8 *handle);
+
+/*
+ * Hash of memory, registers, index, pc, stack, timers and display, kept
+ * up to date incrementally so this is O(1).
+ */
+CIPI8_API uint64_t cipi8_state_hash(const cipi8 *handle);
+
+/*
+ * Concurrent set of state hashes, insert and contains may be called from
+ * any number of threads.
+ */
+typedef struct cipi8_tt cipi8_tt;
+
+#define CIPI8_TT_MAX_CAPACITY_LOG2 32u
+
+/*
+ * Holds up to 2^capacity_log2 hashes at 8 bytes each. NULL if
+ * capacity_log2 is above CIPI8_TT_MAX_CAPACITY_LOG2 or the table could not
+ * be allocated.
+ */
+CIPI8_API cipi8_tt *cipi8_tt_create(uint32_t capacity_log2);
+CIPI8_API void cipi8_tt_destroy(cipi8_tt *table);
+
+/*
+ * Returns 1 if the hash was not seen before, 0 otherwise.
+ */
+CIPI8_API int cipi8_tt_insert(cipi8_tt *table, uint64_t hash);
+CIPI8_API int cipi8_tt_contains(const cipi8_tt *table, uint64_t hash);
+CIPI8_API size_t cipi8_tt_size(const cipi8_tt *table);
+
+/*
+ * Snapshots are opaque blobs of cipi8_snapshot_size() bytes. Both return 0
+ * on success and -1 if `size` is too small.
+ */
+CIPI8_API size_t cipi8_snapshot_size(void);
+CIPI8_API int cipi8_snapshot(const cipi8 *handle, void *buffer, size_t size);
+CIPI8_API int cipi8_restore(cipi8 *handle, const void *buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
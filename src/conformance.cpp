@@ -0,0 +1,440 @@
+#include "chip8.h"
+#include "cipi8.h"
+#include "external/argparse.hpp"
+#include "external/nhlog.h"
+#include "scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+/*
+ * Conformance runner: runs every rom with a scripted keypad on every
+ * engine and compares the display and state hash after each frame against
+ * golden files made by the plain interpreter.
+ */
+
+static const char *GOLDEN_MAGIC = "cipi8-golden";
+static const int GOLDEN_VERSION = 1;
+
+// machines the batch engine steps together through cipi8_step_many.
+static const size_t BATCH_SIZE = 4;
+
+struct RunOptions {
+  unsigned int frames;
+  unsigned int ipf;
+  uint64_t seed;
+};
+
+struct FrameHash {
+  uint64_t display;
+  uint64_t state;
+};
+
+// hashes after every frame of one machine.
+typedef std::vector<FrameHash> Trace;
+
+enum class Engine { INTERPRETER, HOOKED, STEPPED, FARM, BATCH };
+
+struct EngineInfo {
+  Engine engine;
+  const char *name;
+
+  // false if the engine's timers are allowed to lag while it idles, so only
+  // the display is compared.
+  bool exact_state;
+};
+
+static const EngineInfo ENGINES[] = {
+    {Engine::INTERPRETER, "interpreter", true},
+    {Engine::HOOKED, "hooked", true},
+    {Engine::STEPPED, "stepped", true},
+    {Engine::FARM, "farm", false},
+    {Engine::BATCH, "batch", true},
+};
+static const size_t ENGINE_COUNT = sizeof(ENGINES) / sizeof(ENGINES[0]);
+
+/*
+ * Keypad for a frame: after a quiet second, one key is held for 8 frames
+ * out of every 40, stepping through the keys in a scattered order.
+ */
+static uint16_t script_keypad(unsigned int frame) {
+  if (frame < 60 || frame % 40 >= 8) {
+    return 0;
+  }
+  return 1u << (frame / 40 * 7 % 16);
+}
+
+// FNV-1a.
+static uint64_t hash_bytes(const uint8_t *data, size_t size) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ data[i]) * 0x100000001B3ull;
+  }
+  return hash;
+}
+
+static FrameHash hash_frame(const Chip8 &chip8) {
+  uint8_t packed[PACKED_DISPLAY_SIZE];
+  chip8.pack_display(packed);
+  return FrameHash{hash_bytes(packed, sizeof(packed)), chip8.state_hash()};
+}
+
+static Chip8 make_machine(const std::vector<uint8_t> &rom,
+                          const RunOptions &options) {
+  Chip8 chip8;
+  chip8.load_rom(rom.data(), rom.size());
+  chip8.seed(options.seed);
+  return chip8;
+}
+
+/*
+ * RunFrame with hooks that never stop, the path the debugger takes.
+ */
+struct NullHooks {
+  bool before_cycle(Chip8 &) { return true; }
+};
+
+static std::vector<Trace> run_engine(Engine engine,
+                                     const std::vector<uint8_t> &rom,
+                                     const RunOptions &options) {
+  std::vector<Trace> traces(1);
+  Trace &trace = traces[0];
+
+  switch (engine) {
+  case Engine::INTERPRETER:
+  case Engine::HOOKED:
+  case Engine::STEPPED: {
+    Chip8 chip8 = make_machine(rom, options);
+    NullHooks hooks;
+    for (unsigned int frame = 0; frame < options.frames; frame++) {
+      chip8.set_keypad_mask(script_keypad(frame));
+      if (engine == Engine::INTERPRETER) {
+        chip8.RunFrame(options.ipf);
+      } else if (engine == Engine::HOOKED) {
+        chip8.RunFrame(options.ipf, hooks);
+      } else {
+        for (unsigned int i = 0; i < options.ipf; i++) {
+          chip8.Cycle();
+        }
+      }
+      trace.push_back(hash_frame(chip8));
+    }
+    break;
+  }
+
+  case Engine::FARM: {
+    Scheduler scheduler(options.ipf, false, 1);
+    scheduler.add(make_machine(rom, options));
+    for (unsigned int frame = 0; frame < options.frames; frame++) {
+      scheduler.set_keypad(0, script_keypad(frame));
+      scheduler.run(1);
+      trace.push_back(hash_frame(scheduler.machine(0)));
+    }
+    break;
+  }
+
+  case Engine::BATCH: {
+    traces.resize(BATCH_SIZE);
+    std::vector<cipi8 *> handles;
+    for (size_t i = 0; i < BATCH_SIZE; i++) {
+      cipi8 *handle = cipi8_create(options.seed);
+      cipi8_load_rom(handle, rom.data(), rom.size());
+      cipi8_set_ipf(handle, options.ipf);
+      handles.push_back(handle);
+    }
+
+    uint8_t packed[CIPI8_PACKED_DISPLAY_SIZE];
+    for (unsigned int frame = 0; frame < options.frames; frame++) {
+      for (cipi8 *handle : handles) {
+        cipi8_set_keypad(handle, script_keypad(frame));
+      }
+      cipi8_step_many(handles.data(), handles.size(), 1);
+      for (size_t i = 0; i < BATCH_SIZE; i++) {
+        cipi8_get_display_packed(handles[i], packed);
+        traces[i].push_back(FrameHash{hash_bytes(packed, sizeof(packed)),
+                                      cipi8_state_hash(handles[i])});
+      }
+    }
+
+    for (cipi8 *handle : handles) {
+      cipi8_destroy(handle);
+    }
+    break;
+  }
+  }
+
+  return traces;
+}
+
+static bool save_golden(const std::filesystem::path &path, const Trace &trace,
+                        const RunOptions &options) {
+  std::ofstream file(path);
+  if (!file) {
+    nhlog_error("Failed to open %s for writing.", path.string().c_str());
+    return false;
+  }
+
+  file << GOLDEN_MAGIC << " " << GOLDEN_VERSION << " frames=" << options.frames
+       << " ipf=" << options.ipf << " seed=" << options.seed << "\n";
+  char line[40];
+  for (const FrameHash &hash : trace) {
+    std::snprintf(line, sizeof(line), "%016llx %016llx\n",
+                  (unsigned long long)hash.display,
+                  (unsigned long long)hash.state);
+    file << line;
+  }
+  return file.good();
+}
+
+/*
+ * Loads a golden, fails with a reason in `error` if it is missing or was
+ * made with different options.
+ */
+static bool load_golden(const std::filesystem::path &path, Trace &trace,
+                        const RunOptions &options, std::string &error) {
+  std::ifstream file(path);
+  if (!file) {
+    error = "no golden, make one with --update";
+    return false;
+  }
+
+  std::string header;
+  std::getline(file, header);
+  char magic[16];
+  int version;
+  unsigned int frames, ipf;
+  unsigned long long seed;
+  if (std::sscanf(header.c_str(), "%15s %d frames=%u ipf=%u seed=%llu", magic,
+                  &version, &frames, &ipf, &seed) != 5 ||
+      std::string(magic) != GOLDEN_MAGIC || version != GOLDEN_VERSION) {
+    error = "golden is not a cipi8 golden file";
+    return false;
+  }
+  if (frames < options.frames || ipf != options.ipf || seed != options.seed) {
+    std::ostringstream text;
+    text << "golden was made with frames=" << frames << " ipf=" << ipf
+         << " seed=" << seed;
+    error = text.str();
+    return false;
+  }
+
+  trace.clear();
+  std::string line;
+  while (trace.size() < options.frames && std::getline(file, line)) {
+    unsigned long long display, state;
+    if (std::sscanf(line.c_str(), "%llx %llx", &display, &state) != 2) {
+      break;
+    }
+    trace.push_back(FrameHash{display, state});
+  }
+  if (trace.size() != options.frames) {
+    error = "golden is truncated";
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Describes the first frame where `trace` leaves `golden`, empty if it
+ * never does.
+ */
+static std::string compare(const Trace &trace, const Trace &golden,
+                           bool exact_state, const RunOptions &options) {
+  for (size_t frame = 0; frame < golden.size(); frame++) {
+    bool display = trace[frame].display != golden[frame].display;
+    bool state = exact_state && trace[frame].state != golden[frame].state;
+    if (!display && !state) {
+      continue;
+    }
+
+    std::ostringstream text;
+    text << (display ? "display" : "state") << " diverges at frame " << frame
+         << ", instructions " << frame * options.ipf << "-"
+         << (frame + 1) * options.ipf - 1;
+    return text.str();
+  }
+  return "";
+}
+
+struct Job {
+  std::filesystem::path rom;
+  const EngineInfo *engine;
+
+  // empty if the engine matched the golden.
+  std::string failure;
+};
+
+static bool read_file(const std::filesystem::path &path,
+                      std::vector<uint8_t> &data) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  data.assign(std::istreambuf_iterator<char>(file),
+              std::istreambuf_iterator<char>());
+  return true;
+}
+
+static void run_job(Job &job, const std::filesystem::path &goldens,
+                    const RunOptions &options, bool update) {
+  std::vector<uint8_t> rom;
+  if (!read_file(job.rom, rom)) {
+    job.failure = "failed to read the rom";
+    return;
+  }
+
+  std::filesystem::path golden_path =
+      goldens / (job.rom.stem().string() + ".golden");
+  std::vector<Trace> traces = run_engine(job.engine->engine, rom, options);
+  if (update) {
+    if (!save_golden(golden_path, traces[0], options)) {
+      job.failure = "failed to write the golden";
+    }
+    return;
+  }
+
+  Trace golden;
+  if (!load_golden(golden_path, golden, options, job.failure)) {
+    return;
+  }
+
+  for (size_t i = 0; i < traces.size() && job.failure.empty(); i++) {
+    job.failure =
+        compare(traces[i], golden, job.engine->exact_state, options);
+    if (!job.failure.empty() && traces.size() > 1) {
+      job.failure = "machine " + std::to_string(i) + ": " + job.failure;
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  nhlog_set_level(NHLOG_ERROR);
+
+  argparse::ArgumentParser program("cipi8-conformance", "1.0.0");
+  program.add_argument("roms")
+      .help("Rom files or directories searched for .ch8 files.")
+      .default_value(std::vector<std::string>{"roms"})
+      .remaining();
+
+  program.add_argument("--goldens")
+      .help("Directory of the golden files.")
+      .default_value(std::string("roms/goldens"));
+
+  program.add_argument("--frames")
+      .help("Frames to run per rom.")
+      .default_value(600)
+      .scan<'i', int>();
+
+  program.add_argument("--ipf")
+      .help("Instructions per frame.")
+      .default_value(10)
+      .scan<'i', int>();
+
+  program.add_argument("--seed")
+      .help("Seed of every machine.")
+      .default_value(1)
+      .scan<'i', int>();
+
+  program.add_argument("--threads")
+      .help("Worker threads, 0 uses every core.")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("--update")
+      .help("Write the goldens from the interpreter instead of checking.")
+      .default_value(false)
+      .implicit_value(true);
+
+  try {
+    program.parse_args(argc, argv);
+  } catch (const std::exception &err) {
+    std::cerr << "Failed to parse arguments." << err.what() << std::endl;
+    std::cerr << program;
+    std::exit(1);
+  }
+
+  RunOptions options;
+  options.frames = std::max(program.get<int>("--frames"), 1);
+  options.ipf = std::max(program.get<int>("--ipf"), 1);
+  options.seed = program.get<int>("--seed");
+  bool update = program.get<bool>("--update");
+  std::filesystem::path goldens = program.get<std::string>("--goldens");
+
+  unsigned int threads = std::max(program.get<int>("--threads"), 0);
+  if (threads == 0) {
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  // directories are searched recursively, in a stable order.
+  std::vector<std::filesystem::path> roms;
+  for (const std::string &name :
+       program.get<std::vector<std::string>>("roms")) {
+    if (std::filesystem::is_directory(name)) {
+      for (const auto &entry :
+           std::filesystem::recursive_directory_iterator(name)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".ch8") {
+          roms.push_back(entry.path());
+        }
+      }
+    } else if (std::filesystem::is_regular_file(name)) {
+      roms.push_back(name);
+    } else {
+      nhlog_error("Skipping %s, not a file or directory.", name.c_str());
+    }
+  }
+  std::sort(roms.begin(), roms.end());
+  if (roms.empty()) {
+    nhlog_error("No roms found.");
+    return EXIT_FAILURE;
+  }
+
+  if (update) {
+    std::filesystem::create_directories(goldens);
+  }
+
+  // goldens come from the interpreter, checks run every engine.
+  std::vector<Job> jobs;
+  for (const std::filesystem::path &rom : roms) {
+    for (size_t engine = 0; engine < (update ? 1 : ENGINE_COUNT); engine++) {
+      jobs.push_back(Job{rom, &ENGINES[engine], ""});
+    }
+  }
+
+  std::atomic<size_t> next_job{0};
+  std::vector<std::thread> workers;
+  for (unsigned int thread = 0; thread < std::min<size_t>(threads, jobs.size());
+       thread++) {
+    workers.emplace_back([&]() {
+      for (size_t job = next_job++; job < jobs.size(); job = next_job++) {
+        run_job(jobs[job], goldens, options, update);
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  size_t failures = 0;
+  for (const Job &job : jobs) {
+    bool ok = job.failure.empty();
+    failures += !ok;
+    std::printf("%-6s %-12s %s%s%s\n", ok ? "ok" : "FAIL", job.engine->name,
+                job.rom.stem().string().c_str(), ok ? "" : ": ",
+                job.failure.c_str());
+  }
+
+  if (update) {
+    std::printf("wrote %zu goldens to %s\n", jobs.size() - failures,
+                goldens.string().c_str());
+  } else {
+    std::printf("%zu of %zu runs match their goldens\n",
+                jobs.size() - failures, jobs.size());
+  }
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,611 @@
+#include "debugger.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+// instructions between polls of the gdb socket for ctrl-c.
+static const unsigned int GDB_POLL_INTERVAL = 1024;
+
+// longest range a watch, dump or listing covers, all of memory. Anything
+// longer only repeats it.
+static const unsigned long MAX_BYTES = 4096;
+static const unsigned long MAX_INSTRUCTIONS = MAX_BYTES / 2;
+
+// register index used by conditions on I.
+static const uint8_t CONDITION_INDEX = 16;
+
+static bool parse_hex(const std::string &text, unsigned long &value) {
+  if (text.empty()) {
+    return false;
+  }
+  char *end;
+  value = std::strtoul(text.c_str(), &end, 16);
+  return *end == '\0';
+}
+
+static std::string to_hex(const uint8_t *data, size_t size) {
+  static const char digits[] = "0123456789abcdef";
+  std::string out;
+  for (size_t i = 0; i < size; i++) {
+    out.push_back(digits[data[i] >> 4]);
+    out.push_back(digits[data[i] & 0xF]);
+  }
+  return out;
+}
+
+static void from_hex(const std::string &text, uint8_t *data, size_t size) {
+  for (size_t i = 0; i < size && 2 * i + 1 < text.size(); i++) {
+    data[i] = std::strtoul(text.substr(2 * i, 2).c_str(), nullptr, 16);
+  }
+}
+
+static uint16_t fetch(const Chip8 &chip8, uint16_t address) {
+  return (chip8.memory[address & 0xFFF] << 8u) |
+         chip8.memory[(address + 1) & 0xFFF];
+}
+
+// constructor.
+Debugger::Debugger(Frontend frontend, int port) : frontend(frontend) {
+  if (frontend == Frontend::GDB) {
+    this->gdb = std::make_unique<GdbStub>();
+    if (!this->gdb->listen(port)) {
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+bool Debugger::before_cycle(Chip8 &chip8) {
+  if (this->quit) {
+    return false;
+  }
+
+  std::string reason = this->stop_reason(chip8);
+  this->resuming = false;
+  if (!reason.empty()) {
+    this->stop(chip8, reason);
+  }
+
+  return !this->quit;
+}
+
+std::string Debugger::stop_reason(Chip8 &chip8) {
+  uint16_t opcode = fetch(chip8, chip8.pc);
+
+  // a trapped machine doesn't run anymore, every resume stops again.
+  if (chip8.trapped()) {
+    return "trap";
+  }
+
+  if (this->gdb && this->gdb->connected() && ++this->poll_countdown >=
+                                                 GDB_POLL_INTERVAL) {
+    this->poll_countdown = 0;
+    if (this->gdb->interrupted()) {
+      return "interrupt";
+    }
+  }
+
+  switch (this->step_mode) {
+  case StepMode::RUN:
+    break;
+  case StepMode::STEP:
+    // the first instruction of a step runs straight after the stop.
+    if (this->step_count <= 1) {
+      return "step";
+    }
+    this->step_count--;
+    break;
+  case StepMode::STEP_OVER:
+    if (chip8.sp < this->step_sp ||
+        (chip8.sp == this->step_sp && chip8.pc == this->step_pc + 2)) {
+      return "step";
+    }
+    break;
+  case StepMode::STEP_OUT:
+    if (chip8.sp < this->step_sp) {
+      return "step";
+    }
+    break;
+  }
+
+  // the instruction the machine stopped at runs once before these can
+  // stop it again.
+  if (this->resuming) {
+    return "";
+  }
+
+  if (this->breakpoints[chip8.pc & 0xFFF]) {
+    return "breakpoint";
+  }
+
+  bool write;
+  size_t first, count;
+  if (memory_access(chip8, opcode, write, first, count)) {
+    const std::bitset<4096> &watch =
+        write ? this->write_watch : this->read_watch;
+    for (size_t i = 0; i < count; i++) {
+      size_t address = (first + i) & 0xFFF;
+      if (watch[address]) {
+        char text[64];
+        std::snprintf(text, sizeof(text), "%s watchpoint at 0x%03zx",
+                      write ? "write" : "read", address);
+        return text;
+      }
+    }
+  }
+
+  for (Condition &condition : this->conditions) {
+    uint16_t value = condition.reg == CONDITION_INDEX
+                         ? chip8.index
+                         : chip8.registers[condition.reg];
+    bool is_true = false;
+    switch (condition.op) {
+    case '=':
+      is_true = value == condition.value;
+      break;
+    case '!':
+      is_true = value != condition.value;
+      break;
+    case '<':
+      is_true = value < condition.value;
+      break;
+    case '>':
+      is_true = value > condition.value;
+      break;
+    }
+
+    bool became_true = is_true && !condition.was_true;
+    condition.was_true = is_true;
+    if (became_true) {
+      return "condition";
+    }
+  }
+
+  return "";
+}
+
+bool Debugger::memory_access(const Chip8 &chip8, uint16_t opcode, bool &write,
+                             size_t &first, size_t &count) {
+  uint8_t x = (opcode & 0x0F00u) >> 8u;
+  first = chip8.index;
+
+  switch (opcode & 0xF0FFu) {
+  case 0xF033:
+    write = true;
+    count = 3;
+    return true;
+  case 0xF055:
+    write = true;
+    count = x + 1;
+    return true;
+  case 0xF065:
+    write = false;
+    count = x + 1;
+    return true;
+  }
+
+  if ((opcode & 0xF000u) == 0xD000u) {
+    write = false;
+    count = opcode & 0x000Fu;
+    return count > 0;
+  }
+
+  return false;
+}
+
+void Debugger::stop(Chip8 &chip8, const std::string &reason) {
+  if (this->frontend == Frontend::GDB) {
+    this->gdb_session(chip8, reason);
+  } else {
+    std::printf("stopped: %s\n", reason.c_str());
+    this->print_state(chip8);
+    this->terminal_prompt(chip8);
+  }
+  this->resuming = true;
+}
+
+void Debugger::set_step(const Chip8 &chip8, StepMode mode,
+                        unsigned int count) {
+  // stepping over anything but a call is a single step.
+  if (mode == StepMode::STEP_OVER && (fetch(chip8, chip8.pc) & 0xF000u) !=
+                                         0x2000u) {
+    mode = StepMode::STEP;
+    count = 1;
+  }
+
+  this->step_mode = mode;
+  this->step_count = count;
+  this->step_pc = chip8.pc;
+  this->step_sp = chip8.sp;
+}
+
+void Debugger::print_state(const Chip8 &chip8) {
+  for (int i = 0; i < 16; i++) {
+    std::printf("V%X=%02x%s", i, chip8.registers[i], i % 8 == 7 ? "\n" : " ");
+  }
+  std::printf("I=%03x SP=%x DT=%02x ST=%02x\n", chip8.index, chip8.sp,
+              chip8.delay_timer, chip8.sound_timer);
+
+  uint16_t opcode = fetch(chip8, chip8.pc);
+  std::printf("%03x: %04x  %s\n", chip8.pc, opcode,
+              disassemble(opcode).c_str());
+}
+
+void Debugger::terminal_prompt(Chip8 &chip8) {
+  std::string line;
+  while (true) {
+    std::printf("(cipi8) ");
+    std::fflush(stdout);
+    if (!std::getline(std::cin, line)) {
+      this->quit = true;
+      return;
+    }
+
+    std::istringstream words(line);
+    std::string command, a, b, c;
+    words >> command >> a >> b >> c;
+    unsigned long address = 0, length = 1;
+    bool has_address = parse_hex(a, address);
+    if (!b.empty() && !parse_hex(b, length)) {
+      length = 1;
+    }
+    length = std::min(length, MAX_BYTES);
+
+    if (command == "c" || command == "continue") {
+      this->step_mode = StepMode::RUN;
+      return;
+    } else if (command == "s" || command == "step") {
+      this->set_step(chip8, StepMode::STEP, has_address ? address : 1);
+      return;
+    } else if (command == "n" || command == "next") {
+      this->set_step(chip8, StepMode::STEP_OVER, 1);
+      return;
+    } else if (command == "finish") {
+      if (chip8.sp == 0) {
+        std::printf("not in a subroutine.\n");
+        continue;
+      }
+      this->set_step(chip8, StepMode::STEP_OUT, 0);
+      return;
+    } else if (command == "b" || command == "break") {
+      if (!has_address) {
+        std::printf("usage: b ADDR\n");
+        continue;
+      }
+      this->breakpoints.flip(address & 0xFFF);
+      std::printf("breakpoint at 0x%03lx %s\n", address & 0xFFF,
+                  this->breakpoints[address & 0xFFF] ? "set" : "cleared");
+    } else if (command == "w" || command == "r") {
+      if (!has_address) {
+        std::printf("usage: %s ADDR [LEN]\n", command.c_str());
+        continue;
+      }
+      std::bitset<4096> &watch =
+          command == "w" ? this->write_watch : this->read_watch;
+      bool set = !watch[address & 0xFFF];
+      for (unsigned long i = 0; i < length; i++) {
+        watch[(address + i) & 0xFFF] = set;
+      }
+      std::printf("%s watchpoint at 0x%03lx+%lu %s\n",
+                  command == "w" ? "write" : "read", address & 0xFFF, length,
+                  set ? "set" : "cleared");
+    } else if (command == "cond") {
+      // cond Vx OP N, with OP one of = ! < >.
+      if (a == "clear") {
+        this->conditions.clear();
+        continue;
+      }
+      Condition condition{};
+      unsigned long reg = 0, value = 0;
+      if (a == "I" || a == "i") {
+        condition.reg = CONDITION_INDEX;
+      } else if (a.size() == 2 && (a[0] == 'V' || a[0] == 'v') &&
+                 parse_hex(a.substr(1), reg)) {
+        condition.reg = reg;
+      } else {
+        b.clear();
+      }
+      if (b.size() != 1 || std::string("=!<>").find(b[0]) ==
+                               std::string::npos ||
+          !parse_hex(c, value)) {
+        std::printf("usage: cond Vx|I =|!|<|> N, or cond clear\n");
+        continue;
+      }
+      condition.op = b[0];
+      condition.value = value;
+      this->conditions.push_back(condition);
+    } else if (command == "regs") {
+      this->print_state(chip8);
+    } else if (command == "x") {
+      if (!has_address) {
+        address = chip8.index;
+        length = 16;
+      }
+      for (unsigned long i = 0; i < length; i++) {
+        if (i % 16 == 0) {
+          std::printf("%s%03lx:", i ? "\n" : "", (address + i) & 0xFFF);
+        }
+        std::printf(" %02x", chip8.memory[(address + i) & 0xFFF]);
+      }
+      std::printf("\n");
+    } else if (command == "l" || command == "list") {
+      if (!has_address) {
+        address = chip8.pc;
+        length = 8;
+      }
+      length = std::min(length, MAX_INSTRUCTIONS);
+      for (unsigned long i = 0; i < length; i++) {
+        uint16_t at = (address + 2 * i) & 0xFFF;
+        std::printf("%s%03x: %04x  %s\n", at == chip8.pc ? "> " : "  ", at,
+                    fetch(chip8, at), disassemble(fetch(chip8, at)).c_str());
+      }
+    } else if (command == "bt") {
+      std::printf("#0 %03x\n", chip8.pc);
+      // sp can be past the stack after a trap.
+      int depth = std::min<int>(chip8.sp, 16);
+      for (int i = depth - 1; i >= 0; i--) {
+        std::printf("#%d %03x\n", depth - i, chip8.stack[i] - 2);
+      }
+    } else if (command == "q" || command == "quit") {
+      this->quit = true;
+      return;
+    } else if (!command.empty()) {
+      std::printf("commands: c, s [N], n, finish, b ADDR, w ADDR [LEN], "
+                  "r ADDR [LEN], cond Vx OP N, cond clear, regs, x [ADDR "
+                  "[LEN]], l [ADDR [N]], bt, q. Numbers are hex.\n");
+    }
+  }
+}
+
+void Debugger::gdb_session(Chip8 &chip8, const std::string &reason) {
+  if (!this->gdb->connected()) {
+    this->step_mode = StepMode::RUN;
+    return;
+  }
+
+  if (this->gdb_waiting) {
+    this->gdb->send(reason == "interrupt" ? "S02"
+                    : reason == "trap"    ? "S0b"
+                                          : "S05");
+    this->gdb_waiting = false;
+  }
+
+  std::string packet;
+  while (this->gdb->receive(packet)) {
+    if (packet.empty() || packet == "\x03") {
+      continue;
+    }
+
+    char command = packet[0];
+    std::string args = packet.substr(1);
+
+    if (command == '?') {
+      this->gdb->send("S05");
+    } else if (command == 'g') {
+      // V0-VF, I and PC little endian, SP, DT, ST.
+      uint8_t regs[23];
+      std::memcpy(regs, chip8.registers, 16);
+      regs[16] = chip8.index & 0xFF;
+      regs[17] = chip8.index >> 8;
+      regs[18] = chip8.pc & 0xFF;
+      regs[19] = chip8.pc >> 8;
+      regs[20] = chip8.sp;
+      regs[21] = chip8.delay_timer;
+      regs[22] = chip8.sound_timer;
+      this->gdb->send(to_hex(regs, sizeof(regs)));
+    } else if (command == 'G') {
+      uint8_t regs[23] = {};
+      from_hex(args, regs, sizeof(regs));
+      std::memcpy(chip8.registers, regs, 16);
+      chip8.index = regs[16] | (regs[17] << 8);
+      chip8.pc = (regs[18] | (regs[19] << 8)) & 0xFFF;
+      chip8.sp = regs[20] & 0xF;
+      chip8.delay_timer = regs[21];
+      chip8.sound_timer = regs[22];
+      this->gdb->send("OK");
+    } else if (command == 'm' || command == 'M') {
+      // m addr,len and M addr,len:data
+      unsigned long address = std::strtoul(args.c_str(), nullptr, 16);
+      size_t comma = args.find(',');
+      unsigned long length =
+          comma == std::string::npos
+              ? 0
+              : std::min(std::strtoul(args.c_str() + comma + 1, nullptr, 16),
+                         MAX_BYTES);
+      uint8_t data[MAX_BYTES];
+      if (command == 'm') {
+        for (unsigned long i = 0; i < length; i++) {
+          data[i] = chip8.memory[(address + i) & 0xFFF];
+        }
+        this->gdb->send(to_hex(data, length));
+      } else {
+        size_t colon = args.find(':');
+        from_hex(colon == std::string::npos ? "" : args.substr(colon + 1),
+                 data, length);
+        for (unsigned long i = 0; i < length; i++) {
+          chip8.memory[(address + i) & 0xFFF] = data[i];
+        }
+        chip8.rehash();
+        this->gdb->send("OK");
+      }
+    } else if (command == 'Z' || command == 'z') {
+      // Z type,addr,kind. 0 is a breakpoint, 2 write, 3 read, 4 access.
+      bool set = command == 'Z';
+      char type = args.empty() ? ' ' : args[0];
+      size_t comma = args.find(',');
+      if (comma == std::string::npos || type < '0' || type > '4' ||
+          type == '1') {
+        this->gdb->send("");
+        continue;
+      }
+      unsigned long address =
+          std::strtoul(args.c_str() + comma + 1, nullptr, 16);
+      size_t kind = args.find(',', comma + 1);
+      unsigned long length =
+          kind == std::string::npos
+              ? 1
+              : std::min(std::strtoul(args.c_str() + kind + 1, nullptr, 16),
+                         MAX_BYTES);
+      for (unsigned long i = 0; i < std::max(length, 1ul); i++) {
+        size_t at = (address + i) & 0xFFF;
+        if (type == '0') {
+          this->breakpoints[at] = set;
+          break;
+        }
+        if (type == '2' || type == '4') {
+          this->write_watch[at] = set;
+        }
+        if (type == '3' || type == '4') {
+          this->read_watch[at] = set;
+        }
+      }
+      this->gdb->send("OK");
+    } else if (command == 'c' || command == 's') {
+      if (!args.empty()) {
+        chip8.pc = std::strtoul(args.c_str(), nullptr, 16) & 0xFFF;
+      }
+      if (command == 'c') {
+        this->step_mode = StepMode::RUN;
+      } else {
+        this->set_step(chip8, StepMode::STEP, 1);
+      }
+      this->gdb_waiting = true;
+      return;
+    } else if (command == 'k') {
+      this->quit = true;
+      return;
+    } else if (command == 'D') {
+      this->gdb->send("OK");
+      break;
+    } else if (command == 'H') {
+      this->gdb->send("OK");
+    } else if (packet.rfind("qSupported", 0) == 0) {
+      this->gdb->send("PacketSize=4000");
+    } else if (packet == "qAttached") {
+      this->gdb->send("1");
+    } else if (packet == "qC") {
+      this->gdb->send("QC1");
+    } else if (packet == "qfThreadInfo") {
+      this->gdb->send("m1");
+    } else if (packet == "qsThreadInfo") {
+      this->gdb->send("l");
+    } else {
+      this->gdb->send("");
+    }
+  }
+
+  // detached or disconnected, keep running without stopping.
+  nhlog_info("gdb detached.");
+  this->breakpoints.reset();
+  this->read_watch.reset();
+  this->write_watch.reset();
+  this->step_mode = StepMode::RUN;
+}
+
+std::string Debugger::disassemble(uint16_t opcode) {
+  unsigned int x = (opcode & 0x0F00u) >> 8u;
+  unsigned int y = (opcode & 0x00F0u) >> 4u;
+  unsigned int n = opcode & 0x000Fu;
+  unsigned int kk = opcode & 0x00FFu;
+  unsigned int nnn = opcode & 0x0FFFu;
+
+  char text[32];
+  switch (opcode >> 12u) {
+  case 0x0:
+    if (opcode == 0x00E0) {
+      return "CLS";
+    }
+    if (opcode == 0x00EE) {
+      return "RET";
+    }
+    std::snprintf(text, sizeof(text), "SYS %03x", nnn);
+    break;
+  case 0x1:
+    std::snprintf(text, sizeof(text), "JP %03x", nnn);
+    break;
+  case 0x2:
+    std::snprintf(text, sizeof(text), "CALL %03x", nnn);
+    break;
+  case 0x3:
+    std::snprintf(text, sizeof(text), "SE V%X, %02x", x, kk);
+    break;
+  case 0x4:
+    std::snprintf(text, sizeof(text), "SNE V%X, %02x", x, kk);
+    break;
+  case 0x5:
+    std::snprintf(text, sizeof(text), "SE V%X, V%X", x, y);
+    break;
+  case 0x6:
+    std::snprintf(text, sizeof(text), "LD V%X, %02x", x, kk);
+    break;
+  case 0x7:
+    std::snprintf(text, sizeof(text), "ADD V%X, %02x", x, kk);
+    break;
+  case 0x8: {
+    static const char *names[16] = {"LD",  "OR",   "AND", "XOR", "ADD", "SUB",
+                                    "SHR", "SUBN", "?",   "?",   "?",   "?",
+                                    "?",   "?",    "SHL", "?"};
+    std::snprintf(text, sizeof(text), "%s V%X, V%X", names[n], x, y);
+    break;
+  }
+  case 0x9:
+    std::snprintf(text, sizeof(text), "SNE V%X, V%X", x, y);
+    break;
+  case 0xA:
+    std::snprintf(text, sizeof(text), "LD I, %03x", nnn);
+    break;
+  case 0xB:
+    std::snprintf(text, sizeof(text), "JP V0, %03x", nnn);
+    break;
+  case 0xC:
+    std::snprintf(text, sizeof(text), "RND V%X, %02x", x, kk);
+    break;
+  case 0xD:
+    std::snprintf(text, sizeof(text), "DRW V%X, V%X, %X", x, y, n);
+    break;
+  case 0xE:
+    if (kk == 0x9E) {
+      std::snprintf(text, sizeof(text), "SKP V%X", x);
+    } else if (kk == 0xA1) {
+      std::snprintf(text, sizeof(text), "SKNP V%X", x);
+    } else {
+      return "?";
+    }
+    break;
+  case 0xF:
+    switch (kk) {
+    case 0x07:
+      std::snprintf(text, sizeof(text), "LD V%X, DT", x);
+      break;
+    case 0x0A:
+      std::snprintf(text, sizeof(text), "LD V%X, K", x);
+      break;
+    case 0x15:
+      std::snprintf(text, sizeof(text), "LD DT, V%X", x);
+      break;
+    case 0x18:
+      std::snprintf(text, sizeof(text), "LD ST, V%X", x);
+      break;
+    case 0x1E:
+      std::snprintf(text, sizeof(text), "ADD I, V%X", x);
+      break;
+    case 0x29:
+      std::snprintf(text, sizeof(text), "LD F, V%X", x);
+      break;
+    case 0x33:
+      std::snprintf(text, sizeof(text), "LD B, V%X", x);
+      break;
+    case 0x55:
+      std::snprintf(text, sizeof(text), "LD [I], V%X", x);
+      break;
+    case 0x65:
+      std::snprintf(text, sizeof(text), "LD V%X, [I]", x);
+      break;
+    default:
+      return "?";
+    }
+    break;
+  }
+  return text;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "chip8.h"
+#include "external/nhlog.h"
+#include "gdb_stub.h"
+#include <bitset>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Breakpoints, watchpoints and stepping for a running Chip8.
+ *
+ * Attached as hooks through Chip8::RunFrame(ipf, hooks), which checks every
+ * instruction before it executes. Without a debugger the app calls the hook
+ * free RunFrame, so release runs don't pay for any of this.
+ *
+ * Watchpoints cover the accesses instructions make relative to I: Dxyn and
+ * Fx65 reads, Fx33 and Fx55 writes. They are found by decoding the next
+ * instruction, so the core needs no hooks inside its opcodes.
+ */
+class Debugger {
+public:
+  enum class Frontend { TERMINAL, GDB };
+
+  /*
+   * Starts paused. For GDB, waits for a connection on localhost:port.
+   */
+  Debugger(Frontend frontend, int port = 0);
+
+  /*
+   * Hook called before every instruction, blocks in the front end while the
+   * machine is stopped. Returns false once the user asked to quit.
+   */
+  bool before_cycle(Chip8 &chip8);
+
+  bool quit_requested() const { return this->quit; }
+
+  /*
+   * Short assembly listing of an opcode.
+   */
+  static std::string disassemble(uint16_t opcode);
+
+private:
+  enum class StepMode { RUN, STEP, STEP_OVER, STEP_OUT };
+
+  struct Condition {
+    // 0-15 for V0-VF, 16 for I.
+    uint8_t reg;
+    char op;
+    uint16_t value;
+
+    // conditions stop when they become true, not while they stay true.
+    bool was_true;
+  };
+
+  /*
+   * Returns why the machine should stop before the next instruction, or an
+   * empty string.
+   */
+  std::string stop_reason(Chip8 &chip8);
+
+  /*
+   * Memory range the next instruction reads or writes relative to I, false
+   * if it doesn't access memory.
+   */
+  static bool memory_access(const Chip8 &chip8, uint16_t opcode, bool &write,
+                            size_t &first, size_t &count);
+
+  /*
+   * Blocks on the front end until the user resumes.
+   */
+  void stop(Chip8 &chip8, const std::string &reason);
+
+  void terminal_prompt(Chip8 &chip8);
+  void gdb_session(Chip8 &chip8, const std::string &reason);
+
+  /*
+   * Shared by both front ends.
+   */
+  void set_step(const Chip8 &chip8, StepMode mode, unsigned int count);
+  void print_state(const Chip8 &chip8);
+
+private:
+  Frontend frontend;
+  std::unique_ptr<GdbStub> gdb;
+
+  std::bitset<4096> breakpoints;
+  std::bitset<4096> read_watch;
+  std::bitset<4096> write_watch;
+  std::vector<Condition> conditions;
+
+  StepMode step_mode = StepMode::STEP;
+  unsigned int step_count = 0;
+
+  // pc and sp the current step over / step out started at.
+  uint16_t step_pc = 0;
+  uint8_t step_sp = 0;
+
+  // true while the instruction at the stop location should run, so
+  // resuming from a breakpoint doesn't immediately stop again.
+  bool resuming = false;
+
+  // instructions until the gdb socket is polled for an interrupt.
+  unsigned int poll_countdown = 0;
+
+  // gdb resumed the machine and waits for a stop reply.
+  bool gdb_waiting = false;
+
+  bool quit = false;
+};
@@ -0,0 +1,6 @@
+#include "env_server.h"
+
+int main(int argc, char *argv[]) {
+  EnvServer server = EnvServer(argc, argv);
+  return server.run();
+}
@@ -0,0 +1,331 @@
+#include "env_server.h"
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <functional>
+#include <sys/mman.h>
+#include <thread>
+
+// region of the running server, so signals can stop it.
+static cipi8_env_header *running_header = nullptr;
+
+static void handle_signal(int) {
+  if (running_header) {
+    __atomic_store_n(&running_header->shutdown, 1u, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&running_header->request_seq, 1, __ATOMIC_ACQ_REL);
+    cipi8_env_futex_wake(&running_header->request_seq);
+  }
+}
+
+// constructor.
+EnvServer::EnvServer(int argc, char *argv[]) {
+#ifndef CIPI8_DEBUG_MODE
+  nhlog_set_level(NHLOG_INFO);
+#else
+  nhlog_set_level(NHLOG_TRACE);
+#endif
+
+  argparse::ArgumentParser program("cipi8-env", "1.0.0");
+  program.add_argument("rom_file").help("The rom file to run.").required();
+  program.add_argument("--name")
+      .help("Name of the shared memory object.")
+      .default_value(std::string("/cipi8-env"));
+
+  program.add_argument("--envs")
+      .help("Number of environments.")
+      .default_value(64)
+      .scan<'i', int>();
+
+  program.add_argument("--threads")
+      .help("Worker threads, 0 uses every core.")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("--ipf")
+      .help("Instructions per frame.")
+      .default_value(10)
+      .scan<'i', int>();
+
+  program.add_argument("--frame-skip")
+      .help("Frames run per step.")
+      .default_value(1)
+      .scan<'i', int>();
+
+  program.add_argument("--max-frames")
+      .help("Episode length in frames, 0 for none.")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("--ram-start")
+      .help("Start of the ram window copied out after every step.")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("--ram-size")
+      .help("Size of the ram window copied out after every step.")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("--seed")
+      .help("Base seed, environment i episode e uses seed + i + e * envs.")
+      .default_value(0)
+      .scan<'i', int>();
+
+  program.add_argument("--metrics")
+      .help("Write Prometheus metrics to this file, or serve them on "
+            "localhost:PORT.")
+      .default_value(std::string(""));
+
+  program.add_argument("--metrics-interval")
+      .help("Seconds between metrics file writes.")
+      .default_value(1.0)
+      .scan<'g', double>();
+
+  program.add_argument("--memory-policy")
+      .help("Memory accesses past 0xFFF either wrap around or trap, which "
+            "ends the episode.")
+      .default_value(std::string("wrap"));
+
+  program.add_argument("--stack-policy")
+      .help("Stack overflows and underflows either wrap around or trap, "
+            "which ends the episode.")
+      .default_value(std::string("wrap"));
+
+  try {
+    program.parse_args(argc, argv);
+  } catch (const std::exception &err) {
+    std::cerr << "Failed to parse arguments." << err.what() << std::endl;
+    std::cerr << program;
+    std::exit(1);
+  }
+
+  this->filename = program.get<std::string>("rom_file");
+  if (!std::filesystem::exists(this->filename) ||
+      std::filesystem::is_directory(this->filename)) {
+    nhlog_error("Given file does not exist or is a directory.");
+    exit(EXIT_FAILURE);
+  }
+
+  this->shm_name = program.get<std::string>("--name");
+  this->envs = std::max(program.get<int>("--envs"), 1);
+  this->threads = std::max(program.get<int>("--threads"), 0);
+  if (this->threads == 0) {
+    this->threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  this->threads = std::min(this->threads, this->envs);
+  this->seed = program.get<int>("--seed");
+
+  AccessPolicy memory_policy, stack_policy;
+  if (!Chip8::parse_policy(program.get<std::string>("--memory-policy"),
+                           memory_policy) ||
+      !Chip8::parse_policy(program.get<std::string>("--stack-policy"),
+                           stack_policy)) {
+    nhlog_error("Policies are either wrap or trap.");
+    exit(EXIT_FAILURE);
+  }
+
+  uint32_t ram_start = std::clamp(program.get<int>("--ram-start"), 0, 4095);
+  uint32_t ram_size =
+      std::clamp(program.get<int>("--ram-size"), 0, 4096 - (int)ram_start);
+
+  if (!this->create_region(ram_start, ram_size,
+                           std::max(program.get<int>("--frame-skip"), 1),
+                           std::max(program.get<int>("--ipf"), 1),
+                           std::max(program.get<int>("--max-frames"), 0))) {
+    exit(EXIT_FAILURE);
+  }
+
+  this->initial = std::make_unique<Chip8>(this->filename);
+  this->initial->set_memory_policy(memory_policy);
+  this->initial->set_stack_policy(stack_policy);
+  this->pools.resize(this->threads);
+  this->machines.assign(this->envs, nullptr);
+  this->episodes.assign(this->envs, 0);
+
+  auto metrics = program.get<std::string>("--metrics");
+  if (!metrics.empty()) {
+    this->metrics = std::make_unique<Metrics>(
+        metrics, "env", this->threads,
+        std::max(program.get<double>("--metrics-interval"), 0.01));
+  }
+
+  nhlog_info("serving %u envs on %s with %u threads, region=%zu bytes",
+             this->envs, this->shm_name.c_str(), this->threads,
+             this->region_size);
+}
+
+EnvServer::~EnvServer() {
+  if (this->header) {
+    running_header = nullptr;
+    munmap(this->header, this->region_size);
+    shm_unlink(this->shm_name.c_str());
+  }
+}
+
+bool EnvServer::create_region(uint32_t ram_start, uint32_t ram_size,
+                              uint32_t frames_per_step, uint32_t ipf,
+                              uint32_t max_frames) {
+  size_t slot_size = (sizeof(cipi8_env_slot) + ram_size + 63) & ~size_t(63);
+  size_t slots_offset = (sizeof(cipi8_env_header) + 63) & ~size_t(63);
+  this->region_size = slots_offset + slot_size * this->envs;
+
+  int fd = shm_open(this->shm_name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+  if (fd < 0) {
+    nhlog_error("Failed to create shared memory %s: %s",
+                this->shm_name.c_str(), std::strerror(errno));
+    return false;
+  }
+
+  if (ftruncate(fd, this->region_size) != 0) {
+    nhlog_error("Failed to size shared memory: %s", std::strerror(errno));
+    close(fd);
+    return false;
+  }
+
+  void *region = mmap(nullptr, this->region_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+  close(fd);
+  if (region == MAP_FAILED) {
+    nhlog_error("Failed to map shared memory: %s", std::strerror(errno));
+    return false;
+  }
+
+  this->header = static_cast<cipi8_env_header *>(region);
+  std::memset(region, 0, this->region_size);
+  this->header->version = CIPI8_ENV_VERSION;
+  this->header->num_envs = this->envs;
+  this->header->slot_size = slot_size;
+  this->header->slots_offset = slots_offset;
+  this->header->ram_window_start = ram_start;
+  this->header->ram_window_size = ram_size;
+  this->header->frames_per_step = frames_per_step;
+  this->header->ipf = ipf;
+  this->header->max_frames = max_frames;
+  return true;
+}
+
+int EnvServer::run() {
+  running_header = this->header;
+  std::signal(SIGINT, handle_signal);
+  std::signal(SIGTERM, handle_signal);
+
+  this->pending.store(this->threads, std::memory_order_relaxed);
+
+  std::latch ready(this->threads);
+  std::vector<std::thread> workers;
+  for (unsigned int i = 0; i < this->threads; i++) {
+    unsigned int first = (uint64_t)this->envs * i / this->threads;
+    unsigned int last = (uint64_t)this->envs * (i + 1) / this->threads;
+    workers.emplace_back(&EnvServer::work, this, i, first, last,
+                         std::ref(ready));
+  }
+
+  // written once every worker is ready, clients wait for it before
+  // reading the rest or sending a request.
+  ready.wait();
+  __atomic_store_n(&this->header->magic, CIPI8_ENV_MAGIC, __ATOMIC_RELEASE);
+
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  nhlog_info("shutting down.");
+  return EXIT_SUCCESS;
+}
+
+void EnvServer::work(unsigned int worker, unsigned int first,
+                     unsigned int last, std::latch &ready) {
+  MetricsShard *metrics =
+      this->metrics ? &this->metrics->shard(worker) : nullptr;
+
+  // no request comes before the magic, so every worker starts from the
+  // sequence the cleared region holds.
+  uint32_t seen = 0;
+
+  // clients may read the first observations before stepping, so they are
+  // written before the magic is.
+  this->pools[worker] = std::make_unique<Chip8Pool>(last - first);
+  for (unsigned int env = first; env < last; env++) {
+    this->machines[env] = this->pools[worker]->acquire(*this->initial);
+    this->reset(env);
+    this->observe(env);
+  }
+  ready.count_down();
+
+  while (true) {
+    uint32_t seq = cipi8_env_wait_change(&this->header->request_seq, seen);
+    seen = seq;
+
+    if (__atomic_load_n(&this->header->shutdown, __ATOMIC_ACQUIRE)) {
+      return;
+    }
+
+    auto start = MetricsShard::Clock::now();
+    for (unsigned int env = first; env < last; env++) {
+      this->step(env, metrics);
+    }
+    if (metrics) {
+      metrics->job(MetricsShard::ns_since(start));
+    }
+
+    // last worker to finish publishes the response.
+    if (this->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      this->pending.store(this->threads, std::memory_order_relaxed);
+      __atomic_store_n(&this->header->response_seq, seq, __ATOMIC_RELEASE);
+      cipi8_env_futex_wake(&this->header->response_seq);
+    }
+  }
+}
+
+void EnvServer::step(unsigned int env, MetricsShard *metrics) {
+  cipi8_env_slot *slot = cipi8_env_get_slot(this->header, env);
+  Chip8 &chip8 = *this->machines[env];
+
+  if (slot->reset || slot->done) {
+    this->reset(env, metrics);
+  }
+
+  chip8.set_keypad_mask(slot->keypad);
+  Chip8Counters before = chip8.counters;
+  for (uint32_t i = 0; i < this->header->frames_per_step; i++) {
+    chip8.RunFrame(this->header->ipf);
+  }
+  if (metrics) {
+    metrics->machine(before, chip8.counters, this->header->frames_per_step);
+  }
+  slot->frame += this->header->frames_per_step;
+
+  slot->done = chip8.halted() || (this->header->max_frames != 0 &&
+                                  slot->frame >= this->header->max_frames);
+
+  this->observe(env);
+}
+
+void EnvServer::observe(unsigned int env) {
+  cipi8_env_slot *slot = cipi8_env_get_slot(this->header, env);
+  const Chip8 &chip8 = *this->machines[env];
+
+  // outputs go straight into the shared slot.
+  chip8.pack_display(slot->display);
+  std::memcpy(cipi8_env_get_ram(slot),
+              chip8.memory + this->header->ram_window_start,
+              this->header->ram_window_size);
+}
+
+void EnvServer::reset(unsigned int env, MetricsShard *metrics) {
+  cipi8_env_slot *slot = cipi8_env_get_slot(this->header, env);
+
+  Chip8 &chip8 = *this->machines[env];
+  chip8 = *this->initial;
+  if (metrics) {
+    metrics->restore(sizeof(Chip8));
+  }
+  chip8.seed(this->seed + env + this->episodes[env] * this->envs);
+  this->episodes[env]++;
+
+  slot->reset = 0;
+  slot->done = 0;
+  slot->frame = 0;
+}
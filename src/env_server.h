@@ -0,0 +1,79 @@
+#pragma once
+
+#include "chip8.h"
+#include "chip8_pool.h"
+#include "env_shm.h"
+#include "external/argparse.hpp"
+#include "external/nhlog.h"
+#include "metrics.h"
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <latch>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Steps N headless chip8 instances on behalf of an external process,
+ * communicating only through a posix shared memory region.
+ */
+class EnvServer {
+public:
+  std::string filename;
+  std::string shm_name;
+  unsigned int envs;
+  unsigned int threads;
+  uint64_t seed;
+
+public:
+  EnvServer(int argc, char *argv[]);
+  ~EnvServer();
+  int run();
+
+private:
+  /*
+   * Maps the shared region and fills in the header, all but the magic
+   * which run() writes once the workers are ready.
+   */
+  bool create_region(uint32_t ram_start, uint32_t ram_size,
+                     uint32_t frames_per_step, uint32_t ipf,
+                     uint32_t max_frames);
+
+  /*
+   * Worker thread, owns environments [first, last). It creates their
+   * machines in its own pool, so they live on its NUMA node, and counts
+   * down `ready` once they are reset and observed.
+   */
+  void work(unsigned int worker, unsigned int first, unsigned int last,
+            std::latch &ready);
+
+  /*
+   * Steps a single environment and publishes its outputs, counting into
+   * the worker's `metrics` shard if metrics are enabled.
+   */
+  void step(unsigned int env, MetricsShard *metrics);
+
+  void reset(unsigned int env, MetricsShard *metrics = nullptr);
+
+  /*
+   * Writes the display and ram window of an environment into its slot.
+   */
+  void observe(unsigned int env);
+
+private:
+  cipi8_env_header *header{};
+  size_t region_size{};
+
+  // pristine machine every environment is reset to.
+  std::unique_ptr<Chip8> initial;
+  std::vector<std::unique_ptr<Chip8Pool>> pools;
+  std::vector<Chip8 *> machines;
+  std::vector<uint64_t> episodes;
+
+  // null unless --metrics is given, one shard per worker.
+  std::unique_ptr<Metrics> metrics;
+
+  // workers still stepping the current request.
+  std::atomic<unsigned int> pending{0};
+};
@@ -0,0 +1,124 @@
+/*
+ * Shared memory layout of the cipi8-env server, usable from C and C++.
+ *
+ * The server creates a posix shared memory object holding a header followed
+ * by one slot per environment. A client maps it, writes keypad masks into
+ * the slots and calls cipi8_env_step(), the server steps every environment
+ * and writes the packed display, the ram window and the done flag straight
+ * into the slots. Both sides block on futexes over the sequence counters.
+ */
+#ifndef _CIPI8_ENV_SHM_H_
+#define _CIPI8_ENV_SHM_H_
+
+#include <linux/futex.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define CIPI8_ENV_MAGIC 0x38564E45u /* "ENV8" */
+#define CIPI8_ENV_VERSION 1u
+
+/* spins before falling back to futex_wait. */
+#define CIPI8_ENV_SPIN 4096
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_envs;
+
+  /* bytes between consecutive slots, a multiple of 64. */
+  uint32_t slot_size;
+
+  /* offset of the first slot from the start of the region. */
+  uint32_t slots_offset;
+
+  /* memory copied into every slot after each step. */
+  uint32_t ram_window_start;
+  uint32_t ram_window_size;
+
+  /* frames run per step and instructions per frame. */
+  uint32_t frames_per_step;
+  uint32_t ipf;
+
+  /* episode length in frames, 0 for none. */
+  uint32_t max_frames;
+
+  /* incremented by the client to request a step. */
+  uint32_t request_seq __attribute__((aligned(64)));
+
+  /* set to request_seq by the server once the step is done. */
+  uint32_t response_seq __attribute__((aligned(64)));
+
+  /* set by the client to stop the server. */
+  uint32_t shutdown;
+} cipi8_env_header;
+
+typedef struct {
+  /* in: keypad mask, bit n is key n. */
+  uint16_t keypad;
+
+  /* in: reset this environment before the next step. */
+  uint8_t reset;
+
+  /* out: the rom halted or max_frames was reached, reset on the next step. */
+  uint8_t done;
+
+  /* out: frames since the last reset. */
+  uint32_t frame;
+
+  /* out: display at 1 bit per pixel, msb is the leftmost pixel. */
+  uint8_t display[256];
+
+  /* followed by ram_window_size bytes of ram, see cipi8_env_get_ram. */
+} cipi8_env_slot;
+
+static inline cipi8_env_slot *cipi8_env_get_slot(cipi8_env_header *header,
+                                                 uint32_t env) {
+  return (cipi8_env_slot *)((uint8_t *)header + header->slots_offset +
+                            (uint64_t)env * header->slot_size);
+}
+
+/*
+ * out: ram_window_size bytes starting at ram_window_start.
+ */
+static inline uint8_t *cipi8_env_get_ram(cipi8_env_slot *slot) {
+  return (uint8_t *)(slot + 1);
+}
+
+static inline void cipi8_env_futex_wait(uint32_t *addr, uint32_t value) {
+  syscall(SYS_futex, addr, FUTEX_WAIT, value, NULL, NULL, 0);
+}
+
+static inline void cipi8_env_futex_wake(uint32_t *addr) {
+  syscall(SYS_futex, addr, FUTEX_WAKE, 0x7FFFFFFF, NULL, NULL, 0);
+}
+
+/*
+ * Waits until *addr != value, spinning first, returns the new value.
+ */
+static inline uint32_t cipi8_env_wait_change(uint32_t *addr, uint32_t value) {
+  uint32_t current;
+  int spins = 0;
+  while ((current = __atomic_load_n(addr, __ATOMIC_ACQUIRE)) == value) {
+    if (++spins > CIPI8_ENV_SPIN) {
+      cipi8_env_futex_wait(addr, value);
+    }
+  }
+  return current;
+}
+
+/*
+ * Steps every environment once, blocks until the server is done.
+ */
+static inline void cipi8_env_step(cipi8_env_header *header) {
+  uint32_t seq =
+      __atomic_add_fetch(&header->request_seq, 1, __ATOMIC_ACQ_REL);
+  cipi8_env_futex_wake(&header->request_seq);
+
+  uint32_t current = __atomic_load_n(&header->response_seq, __ATOMIC_ACQUIRE);
+  while (current != seq) {
+    current = cipi8_env_wait_change(&header->response_seq, current);
+  }
+}
+
+#endif
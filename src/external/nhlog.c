@@ -24,9 +24,8 @@ static void nhlog_stdout(LogEvent *event) {
               level_colors[event->level], level_strings[event->level],
               event->file, event->line);
 
-  std::vsprintf((char *)event->udata, event->fmt, event->ap);
-  std::printf((const char *)event->udata, "\n\x1b[0m");
-  std::printf("\n");
+  std::vprintf(event->fmt, event->ap);
+  std::printf("\x1b[0m\n");
 #else
   fprintf(event->udata, "%s %s%-5s\x1b[0m \x1b[90m%s:%d:\x1b[0m %s",
           time_buffer, level_colors[event->level], level_strings[event->level],
@@ -44,6 +43,11 @@ static struct {
 void nhlog_set_level(int level) { LoggerState.level = level; }
 
 void nhlog_log(int level, const char *file, int line, const char *fmt, ...) {
+  // bail out before touching the clock, trace calls sit in the hot path.
+  if (level < LoggerState.level) {
+    return;
+  }
+
   time_t t = time(NULL);
 
   LogEvent event = {
@@ -0,0 +1,113 @@
+#include "frame_filter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRAME_FILTER_SSE2
+#include <emmintrin.h>
+#endif
+
+// constructor.
+FrameFilter::FrameFilter(FilterMode mode, double decay, unsigned int frames)
+    : mode(mode),
+      decay((uint16_t)std::clamp(std::lround(decay * 256), 0l, 255l)),
+      frames((uint8_t)std::clamp(frames, 1u, 255u)) {}
+
+bool FrameFilter::parse_mode(const std::string &name, FilterMode &mode) {
+  if (name == "none") {
+    mode = FilterMode::NONE;
+  } else if (name == "decay") {
+    mode = FilterMode::DECAY;
+  } else if (name == "or") {
+    mode = FilterMode::OR;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void FrameFilter::apply(const uint32_t *display, uint32_t *out) {
+  if (this->mode == FilterMode::NONE) {
+    std::memcpy(out, display, PIXELS * sizeof(uint32_t));
+    return;
+  }
+#ifdef FRAME_FILTER_SSE2
+  this->apply_sse2(display, out);
+#else
+  this->apply_scalar(display, out);
+#endif
+}
+
+void FrameFilter::apply_scalar(const uint32_t *display, uint32_t *out) {
+  for (size_t i = 0; i < PIXELS; i++) {
+    uint8_t &state = this->plane[i];
+    uint8_t brightness;
+    if (this->mode == FilterMode::DECAY) {
+      state = display[i] ? 0xFF : (state * this->decay) >> 8u;
+      brightness = state;
+    } else {
+      state = display[i] ? this->frames : std::max(state, (uint8_t)1) - 1;
+      brightness = state ? 0xFF : 0;
+    }
+
+    // grey, so a lit pixel stays 0xFFFFFFFF and an unlit one 0.
+    out[i] = brightness * 0x01010101u;
+  }
+}
+
+#ifdef FRAME_FILTER_SSE2
+
+void FrameFilter::apply_sse2(const uint32_t *display, uint32_t *out) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi8(-1);
+  const __m128i decay = _mm_set1_epi16(this->decay);
+  const __m128i frames = _mm_set1_epi8((char)this->frames);
+  const __m128i one = _mm_set1_epi8(1);
+
+  for (size_t i = 0; i < PIXELS; i += 16) {
+    // 0xFF bytes for lit pixels. Pixels are 0 or not, so comparing and
+    // packing with signed saturation keeps every mask byte intact.
+    const __m128i *in = (const __m128i *)(display + i);
+    __m128i unlit = _mm_packs_epi16(
+        _mm_packs_epi32(_mm_cmpeq_epi32(_mm_loadu_si128(in), zero),
+                        _mm_cmpeq_epi32(_mm_loadu_si128(in + 1), zero)),
+        _mm_packs_epi32(_mm_cmpeq_epi32(_mm_loadu_si128(in + 2), zero),
+                        _mm_cmpeq_epi32(_mm_loadu_si128(in + 3), zero)));
+    __m128i lit = _mm_xor_si128(unlit, ones);
+
+    __m128i state = _mm_load_si128((const __m128i *)(this->plane + i));
+    __m128i brightness;
+    if (this->mode == FilterMode::DECAY) {
+      __m128i low = _mm_srli_epi16(
+          _mm_mullo_epi16(_mm_unpacklo_epi8(state, zero), decay), 8);
+      __m128i high = _mm_srli_epi16(
+          _mm_mullo_epi16(_mm_unpackhi_epi8(state, zero), decay), 8);
+      state = _mm_max_epu8(lit, _mm_packus_epi16(low, high));
+      brightness = state;
+    } else {
+      state = _mm_max_epu8(_mm_and_si128(lit, frames),
+                           _mm_subs_epu8(state, one));
+      brightness = _mm_xor_si128(_mm_cmpeq_epi8(state, zero), ones);
+    }
+    _mm_store_si128((__m128i *)(this->plane + i), state);
+
+    // each byte to a grey pixel, brightness * 0x01010101.
+    __m128i low = _mm_unpacklo_epi8(brightness, brightness);
+    __m128i high = _mm_unpackhi_epi8(brightness, brightness);
+    __m128i *pixels = (__m128i *)(out + i);
+    _mm_storeu_si128(pixels, _mm_unpacklo_epi16(low, low));
+    _mm_storeu_si128(pixels + 1, _mm_unpackhi_epi16(low, low));
+    _mm_storeu_si128(pixels + 2, _mm_unpacklo_epi16(high, high));
+    _mm_storeu_si128(pixels + 3, _mm_unpackhi_epi16(high, high));
+  }
+}
+
+#else
+
+void FrameFilter::apply_sse2(const uint32_t *display, uint32_t *out) {
+  this->apply_scalar(display, out);
+}
+
+#endif
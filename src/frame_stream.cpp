@@ -0,0 +1,371 @@
+#include "frame_stream.h"
+#include "external/nhlog.h"
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+size_t stream_encode_delta(const uint8_t *previous, const uint8_t *current,
+                           uint8_t *out) {
+  // trailing unchanged bytes are implied.
+  size_t end = PACKED_DISPLAY_SIZE;
+  while (end > 0 && previous[end - 1] == current[end - 1]) {
+    end--;
+  }
+
+  size_t size = 0;
+  for (size_t i = 0; i < end;) {
+    size_t run = 0;
+    while (i + run < end && run < 128 &&
+           previous[i + run] == current[i + run]) {
+      run++;
+    }
+    if (run > 0) {
+      out[size++] = run - 1;
+      i += run;
+      continue;
+    }
+
+    // a single unchanged byte between changed ones costs as much as a
+    // literal as it does as a skip, and saves a control byte.
+    while (i + run < end && run < 128 &&
+           (previous[i + run] != current[i + run] ||
+            (i + run + 1 < end &&
+             previous[i + run + 1] != current[i + run + 1]))) {
+      run++;
+    }
+    out[size++] = 0x80 | (run - 1);
+    for (size_t k = 0; k < run; k++) {
+      out[size++] = previous[i + k] ^ current[i + k];
+    }
+    i += run;
+  }
+  return size;
+}
+
+bool stream_apply_delta(const uint8_t *delta, size_t size, uint8_t *display) {
+  size_t at = 0;
+  for (size_t i = 0; i < size;) {
+    uint8_t control = delta[i++];
+    size_t run = (control & 0x7Fu) + 1;
+    if (at + run > PACKED_DISPLAY_SIZE) {
+      return false;
+    }
+
+    if (control & 0x80u) {
+      if (i + run > size) {
+        return false;
+      }
+      for (size_t k = 0; k < run; k++) {
+        display[at + k] ^= delta[i + k];
+      }
+      i += run;
+    }
+    at += run;
+  }
+  return true;
+}
+
+void stream_write_header(std::vector<uint8_t> &out, StreamMessage type,
+                         size_t size) {
+  out.push_back(type);
+  out.push_back(size & 0xFFu);
+  out.push_back(size >> 8u);
+}
+
+static void write_u32(std::vector<uint8_t> &out, uint32_t value) {
+  for (int shift = 0; shift < 32; shift += 8) {
+    out.push_back(value >> shift);
+  }
+}
+
+#ifdef _WIN32
+
+StreamServer::StreamServer(const std::string &path) : path(path) {
+  nhlog_error("Streaming is not supported on this platform.");
+  exit(EXIT_FAILURE);
+}
+
+StreamServer::~StreamServer() {}
+
+void StreamServer::publish(const Chip8 &) {}
+
+void StreamServer::serve() {}
+
+void StreamServer::accept_viewer() {}
+
+void StreamServer::queue_frame(Viewer &) {}
+
+bool StreamServer::flush(Viewer &) { return false; }
+
+bool StreamServer::receive(Viewer &) { return false; }
+
+#else
+
+static void set_nonblocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// constructor.
+StreamServer::StreamServer(const std::string &path) : path(path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    nhlog_error("Stream socket path %s is too long.", path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  std::strcpy(address.sun_path, path.c_str());
+
+  // a socket nobody answers on was left by a server which died.
+  this->server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (this->server >= 0 &&
+      connect(this->server, (sockaddr *)&address, sizeof(address)) == 0) {
+    nhlog_error("%s is in use by another stream.", path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  close(this->server);
+  struct stat existing;
+  if (stat(path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+    unlink(path.c_str());
+  }
+
+  this->server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (this->server < 0 ||
+      bind(this->server, (sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(this->server, 8) != 0 ||
+      socketpair(AF_UNIX, SOCK_STREAM, 0, this->wake_pipe) != 0) {
+    nhlog_error("Failed to stream on %s: %s", path.c_str(),
+                std::strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  set_nonblocking(this->server);
+  set_nonblocking(this->wake_pipe[0]);
+  set_nonblocking(this->wake_pipe[1]);
+
+  nhlog_info("streaming on %s", path.c_str());
+  this->thread = std::thread(&StreamServer::serve, this);
+}
+
+StreamServer::~StreamServer() {
+  this->stop.store(true, std::memory_order_relaxed);
+  send(this->wake_pipe[1], "", 1, MSG_NOSIGNAL);
+  this->thread.join();
+
+  for (Viewer &viewer : this->viewers) {
+    close(viewer.socket);
+  }
+  close(this->server);
+  close(this->wake_pipe[0]);
+  close(this->wake_pipe[1]);
+  unlink(this->path.c_str());
+
+  nhlog_info("streamed %llu frames in %llu bytes.",
+             (unsigned long long)this->frames_sent,
+             (unsigned long long)this->bytes_sent);
+}
+
+void StreamServer::publish(const Chip8 &chip8) {
+  this->frame_number++;
+
+  // packing costs more than a fast headless frame, so frames are only
+  // packed while someone watches and the server waits for one.
+  if (!this->watched.load(std::memory_order_relaxed) ||
+      this->wake_pending.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  Frame &frame = this->frames.back();
+  chip8.pack_display(frame.display.data());
+  frame.number = this->frame_number;
+  this->frames.publish();
+
+  this->wake_pending.store(true, std::memory_order_relaxed);
+  send(this->wake_pipe[1], "", 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+void StreamServer::serve() {
+  const auto frame_interval = std::chrono::milliseconds(1);
+  auto next_frame = std::chrono::steady_clock::now();
+
+  std::vector<pollfd> fds;
+  while (!this->stop.load(std::memory_order_relaxed)) {
+    fds.clear();
+    fds.push_back({this->server, POLLIN, 0});
+    fds.push_back({this->wake_pipe[0], POLLIN, 0});
+    for (const Viewer &viewer : this->viewers) {
+      short events = POLLIN;
+      if (viewer.out_sent < viewer.out.size()) {
+        events |= POLLOUT;
+      }
+      fds.push_back({viewer.socket, events, 0});
+    }
+
+    if (poll(fds.data(), fds.size(), 100) < 0 && errno != EINTR) {
+      nhlog_error("Stream poll failed: %s", std::strerror(errno));
+      return;
+    }
+
+    // cleared before taking the frame, so a frame published after it
+    // wakes the server again.
+    char drain[64];
+    while (recv(this->wake_pipe[0], drain, sizeof(drain), 0) > 0) {
+    }
+    this->wake_pending.store(false, std::memory_order_relaxed);
+    if (std::chrono::steady_clock::now() >= next_frame &&
+        this->frames.update()) {
+      this->latest = this->frames.front();
+      next_frame = std::chrono::steady_clock::now() + frame_interval;
+    }
+
+    size_t before = this->viewers.size();
+    for (size_t i = 0; i < this->viewers.size();) {
+      Viewer &viewer = this->viewers[i];
+      bool open = true;
+      if (fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)) {
+        open = this->receive(viewer);
+      }
+      if (open) {
+        this->queue_frame(viewer);
+        open = this->flush(viewer);
+      }
+
+      if (open) {
+        i++;
+        continue;
+      }
+      close(viewer.socket);
+      this->viewers.erase(this->viewers.begin() + i);
+      fds.erase(fds.begin() + i + 2);
+    }
+
+    // keys held by a viewer which left would never be released.
+    if (this->viewers.size() < before) {
+      nhlog_info("stream viewer left, %zu watching.", this->viewers.size());
+      this->keys.store(0, std::memory_order_relaxed);
+    }
+
+    if (fds[0].revents & POLLIN) {
+      this->accept_viewer();
+    }
+    this->watched.store(!this->viewers.empty(), std::memory_order_relaxed);
+
+    // a frame published meanwhile is taken once the interval is over.
+    std::this_thread::sleep_until(next_frame);
+  }
+}
+
+void StreamServer::accept_viewer() {
+  int socket = accept(this->server, nullptr, nullptr);
+  if (socket < 0) {
+    return;
+  }
+  set_nonblocking(socket);
+#ifdef SO_NOSIGPIPE
+  int on = 1;
+  setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+  Viewer viewer;
+  viewer.socket = socket;
+  viewer.shown = this->latest.display;
+  viewer.shown_number = this->latest.number;
+
+  stream_write_header(viewer.out, STREAM_HELLO, 7);
+  viewer.out.insert(viewer.out.end(), {'C', '8', 'F', 'S', STREAM_VERSION,
+                                       (uint8_t)VIDEO_WIDTH,
+                                       (uint8_t)VIDEO_HEIGHT});
+  stream_write_header(viewer.out, STREAM_KEYFRAME, 4 + PACKED_DISPLAY_SIZE);
+  write_u32(viewer.out, viewer.shown_number);
+  viewer.out.insert(viewer.out.end(), viewer.shown.begin(), viewer.shown.end());
+  this->frames_sent++;
+
+  this->viewers.push_back(std::move(viewer));
+  nhlog_info("stream viewer joined, %zu watching.", this->viewers.size());
+}
+
+void StreamServer::queue_frame(Viewer &viewer) {
+  // a viewer still sending catches up once it is done.
+  if (viewer.out_sent < viewer.out.size() ||
+      viewer.shown_number == this->latest.number) {
+    return;
+  }
+
+  uint8_t delta[STREAM_MAX_DELTA];
+  size_t size = stream_encode_delta(viewer.shown.data(),
+                                    this->latest.display.data(), delta);
+  viewer.shown = this->latest.display;
+  viewer.shown_number = this->latest.number;
+  if (size == 0) {
+    return;
+  }
+
+  viewer.out.clear();
+  viewer.out_sent = 0;
+  stream_write_header(viewer.out, STREAM_DELTA, 4 + size);
+  write_u32(viewer.out, viewer.shown_number);
+  viewer.out.insert(viewer.out.end(), delta, delta + size);
+  this->frames_sent++;
+}
+
+bool StreamServer::flush(Viewer &viewer) {
+  while (viewer.out_sent < viewer.out.size()) {
+    ssize_t sent =
+        send(viewer.socket, viewer.out.data() + viewer.out_sent,
+             viewer.out.size() - viewer.out_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    viewer.out_sent += sent;
+    this->bytes_sent += sent;
+  }
+  return true;
+}
+
+bool StreamServer::receive(Viewer &viewer) {
+  uint8_t buffer[256];
+  while (true) {
+    ssize_t received = recv(viewer.socket, buffer, sizeof(buffer), 0);
+    if (received == 0) {
+      return false;
+    }
+    if (received < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        break;
+      }
+      return false;
+    }
+    viewer.in.insert(viewer.in.end(), buffer, buffer + received);
+  }
+
+  // unknown messages are skipped, for viewers of newer versions.
+  size_t at = 0;
+  while (viewer.in.size() - at >= STREAM_HEADER_SIZE) {
+    size_t size = viewer.in[at + 1] | (viewer.in[at + 2] << 8u);
+    if (viewer.in.size() - at < STREAM_HEADER_SIZE + size) {
+      break;
+    }
+
+    const uint8_t *payload = viewer.in.data() + at + STREAM_HEADER_SIZE;
+    if (viewer.in[at] == STREAM_KEYPAD && size == 2) {
+      this->keys.store(payload[0] | (payload[1] << 8u),
+                       std::memory_order_relaxed);
+    }
+    at += STREAM_HEADER_SIZE + size;
+  }
+  viewer.in.erase(viewer.in.begin(), viewer.in.begin() + at);
+  return true;
+}
+
+#endif
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "chip8.h"
+#include "triple_buffer.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Wire format of display streams, little endian.
+ *
+ * Every message is a type byte and a 16 bit payload length, then the
+ * payload. The server starts with HELLO and a KEYFRAME, then sends a DELTA
+ * whenever the display changed, against the display the viewer last got.
+ * Viewers send KEYPAD messages back.
+ *
+ *   HELLO     "C8FS", version, width, height.
+ *   KEYFRAME  32 bit frame number, packed display.
+ *   DELTA     32 bit frame number, run length encoded xor of the packed
+ *             displays. A control byte below 0x80 skips that many plus
+ *             one unchanged bytes, from 0x80 up it is followed by its low
+ *             7 bits plus one literal xor bytes. Bytes past the end are
+ *             unchanged.
+ *   KEYPAD    16 bit mask, bit n is key n.
+ */
+enum StreamMessage : uint8_t {
+  STREAM_HELLO = 0,
+  STREAM_KEYFRAME = 1,
+  STREAM_DELTA = 2,
+  STREAM_KEYPAD = 3,
+};
+
+const uint8_t STREAM_VERSION = 1;
+const size_t STREAM_HEADER_SIZE = 3;
+
+// largest delta, every byte changed.
+const size_t STREAM_MAX_DELTA =
+    PACKED_DISPLAY_SIZE + (PACKED_DISPLAY_SIZE + 127) / 128;
+
+/*
+ * Encodes the change from `previous` to `current`, both packed displays,
+ * into `out` of at least STREAM_MAX_DELTA bytes. Returns its size, 0 if
+ * nothing changed.
+ */
+size_t stream_encode_delta(const uint8_t *previous, const uint8_t *current,
+                           uint8_t *out);
+
+/*
+ * Applies a delta to the packed `display`. False if it is malformed.
+ */
+bool stream_apply_delta(const uint8_t *delta, size_t size, uint8_t *display);
+
+/*
+ * Appends a message header for a payload of `size` bytes.
+ */
+void stream_write_header(std::vector<uint8_t> &out, StreamMessage type,
+                         size_t size);
+
+/*
+ * Serves the display of one machine to viewers on a unix socket, such as
+ * cipi8-view, and takes their keypad back.
+ *
+ * The emulation thread only publishes frames into a triple buffer and
+ * pokes a socket pair, so it never waits on a viewer. A server thread encodes
+ * each viewer's deltas against the display that viewer last got: a viewer
+ * still sending the previous frame misses frames and then gets a single
+ * delta to catch up. Frames are taken at most every millisecond, more
+ * than any display shows, so a headless run streams at full speed. Posix
+ * only.
+ */
+class StreamServer {
+public:
+  /*
+   * Listens on `path`, replacing a stale socket left there.
+   */
+  explicit StreamServer(const std::string &path);
+
+  /*
+   * Stops the server thread, disconnects viewers and removes the socket.
+   */
+  ~StreamServer();
+
+  StreamServer(const StreamServer &) = delete;
+  StreamServer &operator=(const StreamServer &) = delete;
+
+  /*
+   * Called from the emulation thread once per frame.
+   */
+  void publish(const Chip8 &chip8);
+
+  /*
+   * Keys held in the latest viewer to send any, 0 once it disconnects.
+   */
+  uint16_t keypad() const {
+    return this->keys.load(std::memory_order_relaxed);
+  }
+
+private:
+  typedef std::array<uint8_t, PACKED_DISPLAY_SIZE> Display;
+
+  struct Frame {
+    Display display;
+    uint32_t number;
+  };
+
+  struct Viewer {
+    int socket;
+
+    // the display the viewer has once `out` is sent.
+    Display shown;
+    uint32_t shown_number;
+
+    std::vector<uint8_t> out;
+    size_t out_sent = 0;
+
+    // partial messages received.
+    std::vector<uint8_t> in;
+  };
+
+  void serve();
+  void accept_viewer();
+
+  /*
+   * Queues the newest frame to a viewer with nothing left to send.
+   */
+  void queue_frame(Viewer &viewer);
+
+  /*
+   * Sends what the socket takes without blocking, false if it closed.
+   */
+  bool flush(Viewer &viewer);
+
+  /*
+   * Reads keypad messages, false if the viewer closed.
+   */
+  bool receive(Viewer &viewer);
+
+private:
+  std::string path;
+  int server = -1;
+
+  // the emulation thread publishes a frame and writes a byte to wake the
+  // server thread while anyone is watching, unless a wake is pending.
+  int wake_pipe[2]{-1, -1};
+  std::atomic<bool> wake_pending{false};
+  std::atomic<bool> watched{false};
+
+  TripleBuffer<Frame> frames;
+  uint32_t frame_number = 0;
+
+  // server thread state, the newest frame taken from `frames`.
+  Frame latest{};
+  std::vector<Viewer> viewers;
+  uint64_t frames_sent = 0;
+  uint64_t bytes_sent = 0;
+
+  std::atomic<uint16_t> keys{0};
+  std::atomic<bool> stop{false};
+  std::thread thread;
+};
@@ -0,0 +1,167 @@
+#include "gdb_stub.h"
+#include "external/nhlog.h"
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+GdbStub::~GdbStub() {
+#ifndef _WIN32
+  if (this->client >= 0) {
+    close(this->client);
+  }
+  if (this->server >= 0) {
+    close(this->server);
+  }
+#endif
+}
+
+#ifdef _WIN32
+
+bool GdbStub::listen(int) {
+  nhlog_error("The gdb stub is not supported on this platform.");
+  return false;
+}
+
+bool GdbStub::receive(std::string &) { return false; }
+
+void GdbStub::send(const std::string &) {}
+
+bool GdbStub::interrupted() { return false; }
+
+#else
+
+bool GdbStub::listen(int port) {
+  this->server = socket(AF_INET, SOCK_STREAM, 0);
+  if (this->server < 0) {
+    nhlog_error("Failed to create gdb socket: %s", std::strerror(errno));
+    return false;
+  }
+
+  int reuse = 1;
+  setsockopt(this->server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  // localhost only, the protocol has no authentication.
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (bind(this->server, (sockaddr *)&address, sizeof(address)) != 0 ||
+      ::listen(this->server, 1) != 0) {
+    nhlog_error("Failed to listen on port %d: %s", port, std::strerror(errno));
+    return false;
+  }
+
+  std::printf("waiting for gdb on localhost:%d\n", port);
+  std::fflush(stdout);
+
+  this->client = accept(this->server, nullptr, nullptr);
+  if (this->client < 0) {
+    nhlog_error("Failed to accept gdb: %s", std::strerror(errno));
+    return false;
+  }
+
+  nhlog_info("gdb connected.");
+  return true;
+}
+
+bool GdbStub::receive(std::string &packet) {
+  packet.clear();
+
+  // 0 before the packet starts, 1 in the data, 2 and 3 in the checksum.
+  int state = 0;
+  uint8_t sum = 0;
+  char checksum[3] = {};
+
+  while (this->client >= 0) {
+    char c;
+    ssize_t n = recv(this->client, &c, 1, 0);
+    if (n <= 0) {
+      close(this->client);
+      this->client = -1;
+      return false;
+    }
+
+    switch (state) {
+    case 0:
+      // acks are skipped, an interrupt is its own packet.
+      if (c == 0x03) {
+        packet.assign(1, 0x03);
+        return true;
+      }
+      if (c == '$') {
+        state = 1;
+      }
+      break;
+    case 1:
+      if (c == '#') {
+        state = 2;
+      } else {
+        packet.push_back(c);
+        sum += (uint8_t)c;
+      }
+      break;
+    case 2:
+      checksum[0] = c;
+      state = 3;
+      break;
+    case 3:
+      checksum[1] = c;
+      if ((uint8_t)std::strtoul(checksum, nullptr, 16) == sum) {
+        ::send(this->client, "+", 1, MSG_NOSIGNAL);
+        return true;
+      }
+      ::send(this->client, "-", 1, MSG_NOSIGNAL);
+      packet.clear();
+      sum = 0;
+      state = 0;
+      break;
+    }
+  }
+
+  return false;
+}
+
+void GdbStub::send(const std::string &packet) {
+  if (this->client < 0) {
+    return;
+  }
+
+  uint8_t sum = 0;
+  for (char c : packet) {
+    sum += (uint8_t)c;
+  }
+
+  char trailer[4];
+  std::snprintf(trailer, sizeof(trailer), "#%02x", sum);
+  std::string frame = "$" + packet + trailer;
+  ::send(this->client, frame.data(), frame.size(), MSG_NOSIGNAL);
+}
+
+bool GdbStub::interrupted() {
+  if (this->client < 0) {
+    return false;
+  }
+
+  char c;
+  ssize_t n = recv(this->client, &c, 1, MSG_DONTWAIT);
+  if (n == 0) {
+    close(this->client);
+    this->client = -1;
+    return false;
+  }
+  return n == 1 && c == 0x03;
+}
+
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*
+ * Minimal GDB remote serial protocol transport over a localhost TCP socket.
+ * Handles framing, checksums and acks, the Debugger interprets packets.
+ *
+ * Only available on posix systems, elsewhere listen() fails.
+ */
+class GdbStub {
+public:
+  ~GdbStub();
+
+  /*
+   * Listens on 127.0.0.1:port and blocks until gdb connects.
+   */
+  bool listen(int port);
+
+  /*
+   * Blocks until a full packet arrives, returns false if gdb disconnected.
+   * A lone ctrl-c is returned as "\x03".
+   */
+  bool receive(std::string &packet);
+
+  void send(const std::string &packet);
+
+  /*
+   * Non blocking check for a ctrl-c from gdb while the machine runs.
+   */
+  bool interrupted();
+
+  bool connected() const { return this->client >= 0; }
+
+private:
+  int server = -1;
+  int client = -1;
+};
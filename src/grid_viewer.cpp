@@ -0,0 +1,165 @@
+#include "grid_viewer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+// largest window the grid is scaled to by default.
+static const int MAX_WINDOW_WIDTH = 1600;
+static const int MAX_WINDOW_HEIGHT = 900;
+
+static const std::chrono::steady_clock::duration FRAME_TIME =
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / 60.0));
+
+/*
+ * Sleeps until the next 60Hz frame, without catching up after a long stall.
+ */
+static void wait_frame(std::chrono::steady_clock::time_point &next) {
+  auto now = std::chrono::steady_clock::now();
+  next += FRAME_TIME;
+  if (now > next + 4 * FRAME_TIME) {
+    next = now + FRAME_TIME;
+  }
+  std::this_thread::sleep_until(next);
+}
+
+// constructor.
+GridViewer::GridViewer(const Chip8 &initial, uint64_t first_seed,
+                       unsigned int cols, unsigned int rows, unsigned int ipf,
+                       int scale)
+    : cols(cols), rows(rows), ipf(ipf), first_seed(first_seed) {
+  int fit = std::min(MAX_WINDOW_WIDTH / (int)(VIDEO_WIDTH * cols),
+                     MAX_WINDOW_HEIGHT / (int)(VIDEO_HEIGHT * rows));
+  this->scale = std::max(1, std::min(scale, fit));
+
+  this->initial = std::make_unique<Chip8>(initial);
+
+  for (unsigned int i = 0; i < cols * rows; i++) {
+    this->instances.push_back(std::make_unique<Instance>());
+  }
+  for (unsigned int i = 0; i < cols * rows; i++) {
+    this->instances[i]->thread = std::thread(&GridViewer::work, this, i);
+  }
+
+  nhlog_info("grid of %ux%u instances, tile scale %d", cols, rows,
+             this->scale);
+}
+
+GridViewer::~GridViewer() {
+  this->running.store(false, std::memory_order_relaxed);
+  for (std::unique_ptr<Instance> &instance : this->instances) {
+    instance->thread.join();
+  }
+}
+
+bool GridViewer::parse_grid(const std::string &text, unsigned int &cols,
+                            unsigned int &rows) {
+  if (std::sscanf(text.c_str(), "%ux%u", &cols, &rows) != 2) {
+    return false;
+  }
+  // divided rather than multiplied, which could wrap around.
+  return cols > 0 && rows > 0 && cols <= 1024 && rows <= 1024 / cols;
+}
+
+void GridViewer::work(unsigned int index) {
+  Instance &instance = *this->instances[index];
+  Chip8 chip8 = *this->initial;
+  chip8.seed(this->first_seed + index);
+
+  auto next = std::chrono::steady_clock::now();
+  while (this->running.load(std::memory_order_relaxed)) {
+    chip8.set_keypad_mask(this->keypad.load(std::memory_order_relaxed));
+    chip8.RunFrame(this->ipf);
+
+    chip8.pack_display(instance.frames.back().data());
+    instance.frames.publish();
+
+    wait_frame(next);
+  }
+}
+
+bool GridViewer::upload_tile(Platform &platform, unsigned int index) {
+  Instance &instance = *this->instances[index];
+  if (!instance.frames.update() ||
+      std::memcmp(instance.frames.front().data(), instance.shown.data(),
+                  PACKED_DISPLAY_SIZE) == 0) {
+    return false;
+  }
+  instance.shown = instance.frames.front();
+
+  for (size_t pixel = 0; pixel < VIDEO_WIDTH * VIDEO_HEIGHT; pixel++) {
+    bool on = instance.shown[pixel / 8] & (0x80u >> (pixel % 8));
+    this->tile[pixel] = on ? 0xFFFFFFFF : 0;
+  }
+
+  int pitch = sizeof(this->tile[0]) * VIDEO_WIDTH;
+  platform.update_region((index % this->cols) * VIDEO_WIDTH,
+                         (index / this->cols) * VIDEO_HEIGHT, VIDEO_WIDTH,
+                         VIDEO_HEIGHT, this->tile, pitch);
+  return true;
+}
+
+int GridViewer::run(unsigned int frames) {
+  int tile_width = VIDEO_WIDTH * this->scale;
+  int tile_height = VIDEO_HEIGHT * this->scale;
+  Platform platform = Platform(
+      "cipi8 - A Chip8 Emulator.", tile_width * this->cols,
+      tile_height * this->rows, VIDEO_WIDTH * this->cols,
+      VIDEO_HEIGHT * this->rows);
+
+  // every tile starts blank, then only changes are uploaded.
+  std::memset(this->tile, 0, sizeof(this->tile));
+  for (unsigned int i = 0; i < this->instances.size(); i++) {
+    platform.update_region((i % this->cols) * VIDEO_WIDTH,
+                           (i / this->cols) * VIDEO_HEIGHT, VIDEO_WIDTH,
+                           VIDEO_HEIGHT, this->tile,
+                           sizeof(this->tile[0]) * VIDEO_WIDTH);
+  }
+
+  platform.add_overlay(SDLK_F3, true, [&](Platform &platform) {
+    for (unsigned int col = 1; col < this->cols; col++) {
+      platform.fill_rect(col * tile_width, 0, 1, tile_height * this->rows,
+                         0x404040FF);
+    }
+    for (unsigned int row = 1; row < this->rows; row++) {
+      platform.fill_rect(0, row * tile_height, tile_width * this->cols, 1,
+                         0x404040FF);
+    }
+  });
+
+  uint8_t keys[16]{};
+  uint64_t uploads = 0;
+  unsigned int frame = 0;
+  auto start = std::chrono::steady_clock::now();
+  auto next = start;
+
+  while (!platform.process_input(keys)) {
+    uint16_t mask = 0;
+    for (int key = 0; key < 16; key++) {
+      mask |= (keys[key] ? 1u : 0u) << key;
+    }
+    this->keypad.store(mask, std::memory_order_relaxed);
+
+    for (unsigned int i = 0; i < this->instances.size(); i++) {
+      uploads += this->upload_tile(platform, i);
+    }
+    platform.present();
+
+    frame++;
+    if (frames != 0 && frame >= frames) {
+      break;
+    }
+    wait_frame(next);
+  }
+
+  double elapsed =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+  nhlog_info("presented %u frames in %.2fs, uploaded %.1f%% of tiles", frame,
+             elapsed,
+             frame ? 100.0 * uploads / ((double)frame * this->instances.size())
+                   : 0.0);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "chip8.h"
+#include "external/nhlog.h"
+#include "platform.h"
+#include "triple_buffer.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Runs a grid of instances of one rom, each on its own thread at 60Hz, and
+ * shows them all in one window.
+ *
+ * Workers publish packed frames through triple buffers. The window thread
+ * composes them into a single streaming texture, uploading only tiles whose
+ * display changed since they were last shown, and presents once per
+ * refresh. Keys are sent to every instance.
+ */
+class GridViewer {
+public:
+  /*
+   * Every instance starts as a copy of `initial`, with its policies and
+   * timing. Instance i is seeded with `first_seed` + i, so instances of
+   * roms using Cxkk diverge.
+   */
+  GridViewer(const Chip8 &initial, uint64_t first_seed, unsigned int cols,
+             unsigned int rows, unsigned int ipf, int scale);
+
+  /*
+   * Stops and joins the workers.
+   */
+  ~GridViewer();
+
+  /*
+   * Shows the grid until the window is closed, or for `frames` refreshes
+   * if not 0.
+   */
+  int run(unsigned int frames);
+
+  /*
+   * Parses a grid size such as "4x3", 4 columns and 3 rows.
+   */
+  static bool parse_grid(const std::string &text, unsigned int &cols,
+                         unsigned int &rows);
+
+private:
+  typedef std::array<uint8_t, PACKED_DISPLAY_SIZE> Frame;
+
+  // aligned so workers publishing frames don't share cache lines.
+  struct alignas(64) Instance {
+    TripleBuffer<Frame> frames;
+
+    // window thread state, the frame currently in the texture.
+    Frame shown{};
+
+    std::thread thread;
+  };
+
+  void work(unsigned int index);
+
+  /*
+   * Uploads the tile of instance `index` if its newest frame differs from
+   * the one shown. Returns true if it was uploaded.
+   */
+  bool upload_tile(Platform &platform, unsigned int index);
+
+private:
+  unsigned int cols;
+  unsigned int rows;
+  unsigned int ipf;
+  int scale;
+  uint64_t first_seed;
+
+  // every instance starts as a copy of this.
+  std::unique_ptr<Chip8> initial;
+
+  std::vector<std::unique_ptr<Instance>> instances;
+
+  // keys held in the window, bit n is key n.
+  std::atomic<uint16_t> keypad{0};
+  std::atomic<bool> running{true};
+
+  // window thread scratch for unpacking a tile.
+  uint32_t tile[VIDEO_WIDTH * VIDEO_HEIGHT];
+};
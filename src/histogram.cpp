@@ -0,0 +1,76 @@
+#include "histogram.h"
+#include <cstdio>
+
+void Histogram::add(int64_t us) {
+  size_t bucket = 0;
+  while (bucket < BUCKETS - 1 && us > bucket_limit(bucket)) {
+    bucket++;
+  }
+
+  this->counts[bucket]++;
+  this->count++;
+  this->sum += us;
+  if (us > this->max) {
+    this->max = us;
+  }
+}
+
+int64_t Histogram::bucket_limit(size_t bucket) {
+  if (bucket >= BUCKETS - 1) {
+    return INT64_MAX;
+  }
+  return (int64_t)125 << bucket;
+}
+
+int64_t Histogram::percentile(double p) const {
+  if (this->count == 0) {
+    return 0;
+  }
+
+  uint64_t target = (uint64_t)(p * this->count);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < BUCKETS; i++) {
+    seen += this->counts[i];
+    if (seen > target) {
+      return i == BUCKETS - 1 ? this->max : bucket_limit(i);
+    }
+  }
+  return this->max;
+}
+
+std::string Histogram::format(const char *title) const {
+  char line[128];
+  std::string out;
+
+  std::snprintf(line, sizeof(line),
+                "%s: n=%llu mean=%.2fms p50<=%.2fms p99<=%.2fms max=%.2fms\n",
+                title, (unsigned long long)this->count,
+                this->count ? this->sum / 1000.0 / this->count : 0.0,
+                this->percentile(0.5) / 1000.0, this->percentile(0.99) / 1000.0,
+                this->max / 1000.0);
+  out += line;
+
+  uint64_t largest = 1;
+  for (size_t i = 0; i < BUCKETS; i++) {
+    largest = this->counts[i] > largest ? this->counts[i] : largest;
+  }
+
+  for (size_t i = 0; i < BUCKETS; i++) {
+    if (this->counts[i] == 0) {
+      continue;
+    }
+
+    std::string bar(this->counts[i] * 40 / largest, '#');
+    if (i == BUCKETS - 1) {
+      std::snprintf(line, sizeof(line), "  >%8.3fms %8llu %s\n",
+                    bucket_limit(i - 1) / 1000.0,
+                    (unsigned long long)this->counts[i], bar.c_str());
+    } else {
+      std::snprintf(line, sizeof(line), "  <=%7.3fms %8llu %s\n",
+                    bucket_limit(i) / 1000.0,
+                    (unsigned long long)this->counts[i], bar.c_str());
+    }
+    out += line;
+  }
+  return out;
+}
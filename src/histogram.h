@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Fixed bucket latency histogram in microseconds, buckets double in size
+ * starting at 125us. Not thread safe.
+ */
+class Histogram {
+public:
+  static const size_t BUCKETS = 14;
+
+  void add(int64_t us);
+
+  /*
+   * Upper bound of a bucket in microseconds, the last one is unbounded.
+   */
+  static int64_t bucket_limit(size_t bucket);
+
+  /*
+   * Estimated value at percentile `p` (0 to 1), the upper bound of the
+   * bucket it falls in.
+   */
+  int64_t percentile(double p) const;
+
+  /*
+   * Multi line text rendering, one bar per bucket.
+   */
+  std::string format(const char *title) const;
+
+  uint64_t counts[BUCKETS]{};
+  uint64_t count = 0;
+  int64_t sum = 0;
+  int64_t max = 0;
+};
@@ -0,0 +1,141 @@
+#include "input_movie.h"
+#include <cstring>
+#include <fstream>
+
+static const char MAGIC[4] = {'C', '8', 'M', 'V'};
+static const uint8_t VERSION = 2;
+
+static void write_le(std::ostream &out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    out.put((char)(value >> (8 * i)));
+  }
+}
+
+static bool read_le(std::istream &in, uint64_t &value, int bytes) {
+  value = 0;
+  for (int i = 0; i < bytes; i++) {
+    int c = in.get();
+    if (c == EOF) {
+      return false;
+    }
+    value |= (uint64_t)c << (8 * i);
+  }
+  return true;
+}
+
+static void write_varint(std::ostream &out, uint32_t value) {
+  while (value >= 0x80) {
+    out.put((char)((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  out.put((char)value);
+}
+
+static bool read_varint(std::istream &in, uint32_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    int c = in.get();
+    if (c == EOF) {
+      return false;
+    }
+    value |= (uint32_t)(c & 0x7F) << shift;
+    if (!(c & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void InputMovie::record(uint16_t keypad) {
+  if (this->changes.empty() ? keypad != 0
+                            : keypad != this->changes.back().keypad) {
+    this->changes.push_back(Change{this->frames, keypad});
+  }
+  this->frames++;
+}
+
+uint16_t InputMovie::next() {
+  if (this->cursor < this->changes.size() &&
+      this->changes[this->cursor].frame == this->position) {
+    this->keypad = this->changes[this->cursor].keypad;
+    this->cursor++;
+  }
+  this->position++;
+  return this->keypad;
+}
+
+bool InputMovie::save(const std::string &filename) const {
+  std::ofstream file(filename, std::ios::binary);
+  if (!file) {
+    nhlog_error("Failed to open %s for writing.", filename.c_str());
+    return false;
+  }
+
+  file.write(MAGIC, sizeof(MAGIC));
+  file.put((char)VERSION);
+  write_le(file, this->seed, 8);
+  write_le(file, this->ipf, 4);
+  write_le(file, this->memory_policy == AccessPolicy::TRAP, 1);
+  write_le(file, this->stack_policy == AccessPolicy::TRAP, 1);
+  write_le(file, this->rom_hash, 8);
+  write_le(file, this->frames, 4);
+  write_le(file, this->changes.size(), 4);
+
+  uint32_t previous = 0;
+  for (const Change &change : this->changes) {
+    write_varint(file, change.frame - previous);
+    write_le(file, change.keypad, 2);
+    previous = change.frame;
+  }
+
+  return file.good();
+}
+
+bool InputMovie::load(const std::string &filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) {
+    nhlog_error("Failed to open %s.", filename.c_str());
+    return false;
+  }
+
+  char magic[sizeof(MAGIC)];
+  file.read(magic, sizeof(magic));
+  if (!file || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      file.get() != VERSION) {
+    nhlog_error("%s is not an input movie.", filename.c_str());
+    return false;
+  }
+
+  uint64_t seed, ipf, memory_trap, stack_trap, rom_hash, frames, count;
+  if (!read_le(file, seed, 8) || !read_le(file, ipf, 4) ||
+      !read_le(file, memory_trap, 1) || !read_le(file, stack_trap, 1) ||
+      !read_le(file, rom_hash, 8) || !read_le(file, frames, 4) ||
+      !read_le(file, count, 4)) {
+    nhlog_error("%s is truncated.", filename.c_str());
+    return false;
+  }
+
+  this->changes.clear();
+  uint32_t frame = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    uint32_t delta;
+    uint64_t keypad;
+    if (!read_varint(file, delta) || !read_le(file, keypad, 2)) {
+      nhlog_error("%s is truncated.", filename.c_str());
+      return false;
+    }
+    frame += delta;
+    this->changes.push_back(Change{frame, (uint16_t)keypad});
+  }
+
+  this->seed = seed;
+  this->ipf = ipf;
+  this->memory_policy = memory_trap ? AccessPolicy::TRAP : AccessPolicy::WRAP;
+  this->stack_policy = stack_trap ? AccessPolicy::TRAP : AccessPolicy::WRAP;
+  this->rom_hash = rom_hash;
+  this->frames = frames;
+  this->position = 0;
+  this->cursor = 0;
+  this->keypad = 0;
+  return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "chip8.h"
+#include "external/nhlog.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Keypad input of a run, stored as the frames at which the keypad mask
+ * changed. With the seed, ipf and access policies it replays a run exactly.
+ *
+ * File layout, little endian: "C8MV", version byte, seed u64, ipf u32,
+ * memory and stack policy u8 each (0 wrap, 1 trap), rom hash u64, frames
+ * u32, change count u32, then per change the frames since the previous
+ * change as a LEB128 varint and the new mask as u16.
+ */
+class InputMovie {
+public:
+  uint64_t seed = 0;
+
+  // instructions per frame, 0 for Timing::VIP.
+  uint32_t ipf = 0;
+
+  AccessPolicy memory_policy = AccessPolicy::WRAP;
+  AccessPolicy stack_policy = AccessPolicy::WRAP;
+
+  // Chip8::state_hash() of the machine with the rom freshly loaded.
+  uint64_t rom_hash = 0;
+
+  // length of the run in frames.
+  uint32_t frames = 0;
+
+  /*
+   * Recording, called once per frame with the mask the frame runs with.
+   */
+  void record(uint16_t keypad);
+
+  /*
+   * Playback, mask for the next frame. Past the end the last mask is kept.
+   */
+  uint16_t next();
+
+  /*
+   * True once next() returned every recorded frame.
+   */
+  bool finished() const { return this->position >= this->frames; }
+
+  bool save(const std::string &filename) const;
+  bool load(const std::string &filename);
+
+private:
+  struct Change {
+    uint32_t frame;
+    uint16_t keypad;
+  };
+
+  std::vector<Change> changes;
+
+  // playback state.
+  uint32_t position = 0;
+  size_t cursor = 0;
+  uint16_t keypad = 0;
+};
@@ -0,0 +1,88 @@
+#include "latency.h"
+
+// give up on a press after this many frames without progress.
+const unsigned int LATENCY_TIMEOUT_FRAMES = 60;
+
+void LatencyTracker::key_down(uint8_t key) {
+  Press &press = this->presses[key & 0xFu];
+
+  // a press still in flight keeps its original timestamp.
+  if (press.stage != Stage::IDLE) {
+    return;
+  }
+
+  press.stage = Stage::DOWN;
+  press.down = Clock::now();
+  press.frames = 0;
+}
+
+void LatencyTracker::frame_executed(uint16_t keys_read, bool drew) {
+  auto now = Clock::now();
+
+  for (size_t key = 0; key < 16; key++) {
+    Press &press = this->presses[key];
+    switch (press.stage) {
+    case Stage::IDLE:
+    case Stage::DRAWN:
+      break;
+
+    case Stage::DOWN:
+      if (!(keys_read & (1u << key))) {
+        if (++press.frames > LATENCY_TIMEOUT_FRAMES) {
+          press.stage = Stage::IDLE;
+        }
+        break;
+      }
+      press.stage = Stage::READ;
+      press.read = now;
+      press.frames = 0;
+      this->to_read.add(us_between(press.down, now));
+      [[fallthrough]];
+
+    case Stage::READ: {
+      // the frame that read the key counts too, it may have drawn the result.
+      if (drew) {
+        press.stage = Stage::DRAWN;
+        press.drawn = now;
+        this->to_draw.add(us_between(press.down, now));
+      } else if (++press.frames > LATENCY_TIMEOUT_FRAMES) {
+        press.stage = Stage::IDLE;
+        this->no_change++;
+      }
+    } break;
+    }
+  }
+}
+
+void LatencyTracker::presented() {
+  auto now = Clock::now();
+
+  for (size_t key = 0; key < 16; key++) {
+    Press &press = this->presses[key];
+    if (press.stage != Stage::DRAWN) {
+      continue;
+    }
+
+    int64_t us = us_between(press.down, now);
+    this->to_present.add(us);
+    this->recent[this->recent_count % RECENT] = us;
+    this->recent_count++;
+    press.stage = Stage::IDLE;
+  }
+}
+
+std::string LatencyTracker::report() const {
+  std::string out = "input latency\n";
+  out += this->to_read.format("keydown -> core read");
+  out += this->to_draw.format("keydown -> display change");
+  out += this->to_present.format("keydown -> present");
+  out += "presses with no display change: " + std::to_string(this->no_change) +
+         "\n";
+  return out;
+}
+
+int64_t LatencyTracker::us_between(Clock::time_point from,
+                                   Clock::time_point to) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(to - from)
+      .count();
+}
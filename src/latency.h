@@ -0,0 +1,73 @@
+#pragma once
+
+#include "histogram.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/*
+ * Tracks input to photon latency of key presses through 4 stages:
+ * keydown seen by the platform, key read by the core (Ex9E, ExA1, Fx0A),
+ * the next display change and the present that shows it.
+ *
+ * Everything is called from the render thread.
+ */
+class LatencyTracker {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  /*
+   * Platform saw a SDL_KEYDOWN for a chip8 key.
+   */
+  void key_down(uint8_t key);
+
+  /*
+   * A frame was executed, `keys_read` is the mask of keys the core read,
+   * `drew` if the display changed.
+   */
+  void frame_executed(uint16_t keys_read, bool drew);
+
+  /*
+   * SDL_RenderPresent returned.
+   */
+  void presented();
+
+  /*
+   * Histograms for all stages, printed on exit.
+   */
+  std::string report() const;
+
+  // keydown -> core read.
+  Histogram to_read;
+
+  // keydown -> display change.
+  Histogram to_draw;
+
+  // keydown -> present.
+  Histogram to_present;
+
+  // end to end latency of the last few presses, for the overlay.
+  static const size_t RECENT = 32;
+  int64_t recent[RECENT]{};
+  size_t recent_count = 0;
+
+private:
+  enum class Stage { IDLE, DOWN, READ, DRAWN };
+
+  struct Press {
+    Stage stage = Stage::IDLE;
+    Clock::time_point down;
+    Clock::time_point read;
+    Clock::time_point drawn;
+
+    // frames waited in the current stage.
+    unsigned int frames = 0;
+  };
+
+  static int64_t us_between(Clock::time_point from, Clock::time_point to);
+
+  Press presses[16];
+
+  // presses whose read never led to a display change.
+  uint64_t no_change = 0;
+};
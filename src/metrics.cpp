@@ -0,0 +1,295 @@
+#include "metrics.h"
+#include "external/nhlog.h"
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+void MetricsShard::machine(const Chip8Counters &before,
+                           const Chip8Counters &after, uint64_t frames) {
+  add(this->instructions, after.instructions - before.instructions);
+  add(this->draws, after.draws - before.draws);
+  add(this->idle_skips, after.idle_skips - before.idle_skips);
+  add(this->frames, frames);
+}
+
+void MetricsShard::restore(uint64_t bytes) {
+  add(this->restores, 1);
+  add(this->restore_bytes, bytes);
+}
+
+void MetricsShard::job(int64_t ns) {
+  // bucket b holds jobs up to 128ns << b.
+  size_t bucket = ns <= 128 ? 0 : std::bit_width((uint64_t)(ns - 1) >> 7);
+  bucket = std::min(bucket, JOB_BUCKETS - 1);
+
+  add(this->latency_counts[bucket], 1);
+  add(this->latency_count, 1);
+  add(this->latency_sum_ns, ns);
+  add(this->busy_ns, ns);
+}
+
+int64_t MetricsShard::ns_since(Clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                              start)
+      .count();
+}
+
+int64_t MetricsShard::job_bucket_limit(size_t bucket) {
+  if (bucket >= JOB_BUCKETS - 1) {
+    return INT64_MAX;
+  }
+  return (int64_t)128 << bucket;
+}
+
+// constructor.
+Metrics::Metrics(const std::string &target, const std::string &mode,
+                 size_t shards, double interval)
+    : target(target), mode(mode), shard_count(shards),
+      shards(std::make_unique<MetricsShard[]>(shards)),
+      interval(interval), start(MetricsShard::Clock::now()),
+      last_busy_ns(std::make_unique<uint64_t[]>(shards)),
+      last_format(start) {
+  int port = parse_port(target);
+  if (port == 0) {
+    this->exporter = std::thread([this]() {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      while (!this->wake.wait_for(lock, this->interval,
+                                  [this]() { return this->stop; })) {
+        this->write_file();
+      }
+    });
+    return;
+  }
+
+#ifdef _WIN32
+  nhlog_error("Serving metrics over http is not supported on this platform.");
+  exit(EXIT_FAILURE);
+#else
+  // localhost only, the endpoint has no authentication.
+  int server = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+  setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (server < 0 || bind(server, (sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(server, 8) != 0) {
+    nhlog_error("Failed to serve metrics on port %d: %s", port,
+                std::strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  nhlog_info("serving metrics on http://localhost:%d/metrics", port);
+  this->exporter = std::thread(&Metrics::serve, this, server);
+#endif
+}
+
+Metrics::~Metrics() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stop = true;
+  }
+  this->wake.notify_all();
+  this->exporter.join();
+
+  // the final totals, after the workers finished.
+  if (parse_port(this->target) == 0) {
+    this->write_file();
+  }
+}
+
+int Metrics::parse_port(const std::string &target) {
+  std::string port;
+  if (target.rfind("localhost:", 0) == 0) {
+    port = target.substr(10);
+  } else if (target.rfind(":", 0) == 0) {
+    port = target.substr(1);
+  } else {
+    return 0;
+  }
+
+  char *end = nullptr;
+  long value = std::strtol(port.c_str(), &end, 10);
+  return *end == '\0' && value > 0 && value < 65536 ? (int)value : 0;
+}
+
+/*
+ * Writes a single valued metric with its help and type.
+ */
+static void write_metric(std::ostringstream &out, const std::string &labels,
+                         const char *name, const char *type, const char *help,
+                         uint64_t value) {
+  out << "# HELP " << name << " " << help << "\n";
+  out << "# TYPE " << name << " " << type << "\n";
+  out << name << "{" << labels << "} " << value << "\n";
+}
+
+std::string Metrics::format() {
+  uint64_t totals[6]{};
+  uint64_t latency_counts[MetricsShard::JOB_BUCKETS]{};
+  uint64_t latency_count = 0, latency_sum_ns = 0;
+  for (size_t i = 0; i < this->shard_count; i++) {
+    const MetricsShard &shard = this->shards[i];
+    totals[0] += shard.instructions.load(std::memory_order_relaxed);
+    totals[1] += shard.frames.load(std::memory_order_relaxed);
+    totals[2] += shard.draws.load(std::memory_order_relaxed);
+    totals[3] += shard.idle_skips.load(std::memory_order_relaxed);
+    totals[4] += shard.restores.load(std::memory_order_relaxed);
+    totals[5] += shard.restore_bytes.load(std::memory_order_relaxed);
+    for (size_t bucket = 0; bucket < MetricsShard::JOB_BUCKETS; bucket++) {
+      latency_counts[bucket] +=
+          shard.latency_counts[bucket].load(std::memory_order_relaxed);
+    }
+    latency_count += shard.latency_count.load(std::memory_order_relaxed);
+    latency_sum_ns += shard.latency_sum_ns.load(std::memory_order_relaxed);
+  }
+
+  std::string labels = "mode=\"" + this->mode + "\"";
+  std::ostringstream out;
+  write_metric(out, labels, "cipi8_instructions_total", "counter",
+               "Instructions emulated, idle skipped ones included.",
+               totals[0]);
+  write_metric(out, labels, "cipi8_frames_total", "counter",
+               "Frames run, summed over machines.", totals[1]);
+  write_metric(out, labels, "cipi8_draws_total", "counter",
+               "Dxyn instructions executed.", totals[2]);
+  write_metric(out, labels, "cipi8_idle_skips_total", "counter",
+               "Frames cut short by idle skipping.", totals[3]);
+  write_metric(out, labels, "cipi8_restores_total", "counter",
+               "Machines restored from a snapshot or pristine copy.",
+               totals[4]);
+  write_metric(out, labels, "cipi8_restore_bytes_total", "counter",
+               "Bytes copied by restores.", totals[5]);
+
+  // prometheus buckets are cumulative.
+  out << "# HELP cipi8_job_latency_seconds Time per job: a farm tick, a "
+         "worker's share of an environment step or a headless frame.\n";
+  out << "# TYPE cipi8_job_latency_seconds histogram\n";
+  uint64_t cumulative = 0;
+  for (size_t bucket = 0; bucket < MetricsShard::JOB_BUCKETS; bucket++) {
+    cumulative += latency_counts[bucket];
+    out << "cipi8_job_latency_seconds_bucket{" << labels << ",le=\"";
+    if (bucket == MetricsShard::JOB_BUCKETS - 1) {
+      out << "+Inf";
+    } else {
+      out << MetricsShard::job_bucket_limit(bucket) / 1e9;
+    }
+    out << "\"} " << cumulative << "\n";
+  }
+  out << "cipi8_job_latency_seconds_sum{" << labels << "} "
+      << latency_sum_ns / 1e9 << "\n";
+  out << "cipi8_job_latency_seconds_count{" << labels << "} " << latency_count
+      << "\n";
+
+  auto now = MetricsShard::Clock::now();
+  double elapsed =
+      std::chrono::duration<double, std::nano>(now - this->last_format)
+          .count();
+  this->last_format = now;
+
+  out << "# HELP cipi8_worker_busy_seconds_total Time a worker spent on "
+         "jobs.\n";
+  out << "# TYPE cipi8_worker_busy_seconds_total counter\n";
+  std::ostringstream utilisation;
+  for (size_t i = 0; i < this->shard_count; i++) {
+    uint64_t busy = this->shards[i].busy_ns.load(std::memory_order_relaxed);
+    std::string worker = labels + ",worker=\"" + std::to_string(i) + "\"";
+    out << "cipi8_worker_busy_seconds_total{" << worker << "} " << busy / 1e9
+        << "\n";
+    utilisation << "cipi8_worker_utilisation{" << worker << "} "
+                << (elapsed > 0 ? (busy - this->last_busy_ns[i]) / elapsed
+                                : 0.0)
+                << "\n";
+    this->last_busy_ns[i] = busy;
+  }
+  out << "# HELP cipi8_worker_utilisation Share of the time since the last "
+         "export a worker spent on jobs.\n";
+  out << "# TYPE cipi8_worker_utilisation gauge\n";
+  out << utilisation.str();
+
+  out << "# HELP cipi8_uptime_seconds Time since the process started.\n";
+  out << "# TYPE cipi8_uptime_seconds gauge\n";
+  out << "cipi8_uptime_seconds{" << labels << "} "
+      << std::chrono::duration<double>(now - this->start).count() << "\n";
+  return out.str();
+}
+
+void Metrics::write_file() {
+  std::string temporary = this->target + ".tmp";
+  {
+    std::ofstream file(temporary);
+    file << this->format();
+    if (!file) {
+      nhlog_error("Failed to write metrics to %s.", temporary.c_str());
+      return;
+    }
+  }
+  if (std::rename(temporary.c_str(), this->target.c_str()) != 0) {
+    nhlog_error("Failed to replace %s.", this->target.c_str());
+  }
+}
+
+#ifdef _WIN32
+
+void Metrics::serve(int) {}
+
+#else
+
+void Metrics::serve(int server) {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (this->stop) {
+        break;
+      }
+    }
+
+    // wake up regularly to notice stop.
+    pollfd poll_server{server, POLLIN, 0};
+    if (poll(&poll_server, 1, 100) <= 0) {
+      continue;
+    }
+    int client = accept(server, nullptr, nullptr);
+    if (client < 0) {
+      continue;
+    }
+
+    // every path gets the metrics, the request itself is not needed.
+    pollfd poll_client{client, POLLIN, 0};
+    char request[1024];
+    if (poll(&poll_client, 1, 1000) > 0) {
+      recv(client, request, sizeof(request), 0);
+    }
+
+    std::string body = this->format();
+    std::string response =
+        "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " +
+        std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    ::send(client, response.data(), response.size(), MSG_NOSIGNAL);
+    close(client);
+  }
+  close(server);
+}
+
+#endif
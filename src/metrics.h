@@ -0,0 +1,123 @@
+#pragma once
+
+#include "chip8.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/*
+ * Counters of one worker thread. Only that thread writes them, with relaxed
+ * load and store pairs instead of read-modify-writes, and each shard has its
+ * own cache lines, so workers never contend. The exporter reads them from
+ * its own thread.
+ */
+struct alignas(64) MetricsShard {
+  typedef std::chrono::steady_clock Clock;
+
+  // job latency buckets, doubling from 128ns up to the last unbounded one.
+  // Jobs run far below the input latency histogram's first bucket.
+  static const size_t JOB_BUCKETS = 20;
+
+  std::atomic<uint64_t> instructions{0};
+  std::atomic<uint64_t> frames{0};
+  std::atomic<uint64_t> draws{0};
+  std::atomic<uint64_t> idle_skips{0};
+
+  // machines restored from a snapshot or pristine copy, and bytes copied.
+  std::atomic<uint64_t> restores{0};
+  std::atomic<uint64_t> restore_bytes{0};
+
+  // time spent on jobs in nanoseconds, for utilisation.
+  std::atomic<uint64_t> busy_ns{0};
+
+  // latency of jobs in job buckets.
+  std::atomic<uint64_t> latency_counts[JOB_BUCKETS]{};
+  std::atomic<uint64_t> latency_count{0};
+  std::atomic<uint64_t> latency_sum_ns{0};
+
+  /*
+   * A machine ran `frames` frames, `before` are its counters from before.
+   */
+  void machine(const Chip8Counters &before, const Chip8Counters &after,
+               uint64_t frames);
+
+  void restore(uint64_t bytes);
+
+  /*
+   * A job such as a farm tick or an environment step took `ns`.
+   */
+  void job(int64_t ns);
+
+  static int64_t ns_since(Clock::time_point start);
+
+  /*
+   * Upper bound of a job bucket in nanoseconds, the last one is unbounded.
+   */
+  static int64_t job_bucket_limit(size_t bucket);
+
+private:
+  static void add(std::atomic<uint64_t> &counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+  }
+};
+
+/*
+ * Metrics of a headless process in Prometheus text format, summed over the
+ * shards of its worker threads.
+ *
+ * A background thread either rewrites a file every `interval` seconds,
+ * through a rename so readers never see half a file, or serves the metrics
+ * over http on localhost. A file is written once more on destruction.
+ */
+class Metrics {
+public:
+  /*
+   * `target` is a file path, or "localhost:PORT" or ":PORT" for http
+   * (posix only). `mode` labels every metric.
+   */
+  Metrics(const std::string &target, const std::string &mode, size_t shards,
+          double interval);
+  ~Metrics();
+
+  Metrics(const Metrics &) = delete;
+  Metrics &operator=(const Metrics &) = delete;
+
+  MetricsShard &shard(size_t i) { return this->shards[i]; }
+
+  /*
+   * Current metrics in Prometheus text format.
+   */
+  std::string format();
+
+  /*
+   * Port of an http target, 0 if `target` is a file.
+   */
+  static int parse_port(const std::string &target);
+
+private:
+  void write_file();
+  void serve(int port);
+
+private:
+  std::string target;
+  std::string mode;
+  size_t shard_count;
+  std::unique_ptr<MetricsShard[]> shards;
+  std::chrono::duration<double> interval;
+  MetricsShard::Clock::time_point start;
+
+  // busy time and time of the previous format(), for utilisation since.
+  std::unique_ptr<uint64_t[]> last_busy_ns;
+  MetricsShard::Clock::time_point last_format;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stop = false;
+  std::thread exporter;
+};
@@ -0,0 +1,105 @@
+#include "paged_snapshot.h"
+
+std::atomic<uint64_t> PagedSnapshot::next_id{1};
+
+PagedSnapshot::PagedSnapshot(Chip8 &chip8, const PagedSnapshot *parent)
+    : id(next_id.fetch_add(1, std::memory_order_relaxed)),
+      allocated(sizeof(PagedSnapshot)) {
+  bool shared = parent != nullptr && chip8.snapshot_id == parent->id;
+
+  for (size_t page = 0; page < MEMORY_PAGES; page++) {
+    if (shared && !(chip8.dirty_pages & (1u << page))) {
+      this->memory[page] = parent->memory[page];
+      continue;
+    }
+
+    auto copy = std::make_shared<MemoryPage>();
+    std::memcpy(copy->bytes, chip8.memory + page * MEMORY_PAGE_SIZE,
+                MEMORY_PAGE_SIZE);
+    this->memory[page] = std::move(copy);
+    this->allocated += sizeof(MemoryPage);
+  }
+
+  uint8_t packed[PACKED_DISPLAY_SIZE];
+  bool is_packed = false;
+  const uint32_t page_rows = (1u << DISPLAY_PAGE_ROWS) - 1;
+
+  for (size_t page = 0; page < DISPLAY_PAGES; page++) {
+    uint32_t rows = page_rows << (page * DISPLAY_PAGE_ROWS);
+    if (shared && !(chip8.dirty_rows & rows)) {
+      this->display[page] = parent->display[page];
+      continue;
+    }
+
+    if (!is_packed) {
+      chip8.pack_display(packed);
+      is_packed = true;
+    }
+
+    auto copy = std::make_shared<DisplayPage>();
+    std::memcpy(copy->bytes, packed + page * DISPLAY_PAGE_SIZE,
+                DISPLAY_PAGE_SIZE);
+    this->display[page] = std::move(copy);
+    this->allocated += sizeof(DisplayPage);
+  }
+
+  std::memcpy(this->registers, chip8.registers, sizeof(this->registers));
+  std::memcpy(this->stack, chip8.stack, sizeof(this->stack));
+  std::memcpy(this->keypad, chip8.keypad, sizeof(this->keypad));
+  this->index = chip8.index;
+  this->pc = chip8.pc;
+  this->sp = chip8.sp;
+  this->delay_timer = chip8.delay_timer;
+  this->sound_timer = chip8.sound_timer;
+  this->rand_generator = chip8.rand_generator;
+  this->memory_hash = chip8.memory_hash;
+  this->display_hash = chip8.display_hash;
+
+  chip8.snapshot_id = this->id;
+  chip8.dirty_pages = 0;
+  chip8.dirty_rows = 0;
+}
+
+void PagedSnapshot::restore(Chip8 &chip8) const {
+  chip8.clear_fault();
+
+  // a machine matching this snapshot only needs its dirty pages back.
+  bool matches = chip8.snapshot_id == this->id;
+
+  for (size_t page = 0; page < MEMORY_PAGES; page++) {
+    if (matches && !(chip8.dirty_pages & (1u << page))) {
+      continue;
+    }
+    std::memcpy(chip8.memory + page * MEMORY_PAGE_SIZE,
+                this->memory[page]->bytes, MEMORY_PAGE_SIZE);
+  }
+
+  for (size_t i = 0; i < VIDEO_WIDTH * VIDEO_HEIGHT; i++) {
+    size_t row = i / VIDEO_WIDTH;
+    if (matches && !(chip8.dirty_rows & (1u << row))) {
+      i += VIDEO_WIDTH - 1;
+      continue;
+    }
+
+    const DisplayPage &page = *this->display[row / DISPLAY_PAGE_ROWS];
+    size_t bit = i % (DISPLAY_PAGE_ROWS * VIDEO_WIDTH);
+    bool on = page.bytes[bit / 8] & (0x80u >> (bit % 8));
+    chip8.display[i] = on ? 0xFFFFFFFF : 0;
+  }
+
+  std::memcpy(chip8.registers, this->registers, sizeof(this->registers));
+  std::memcpy(chip8.stack, this->stack, sizeof(this->stack));
+  std::memcpy(chip8.keypad, this->keypad, sizeof(this->keypad));
+  chip8.index = this->index;
+  chip8.pc = this->pc;
+  chip8.sp = this->sp;
+  chip8.delay_timer = this->delay_timer;
+  chip8.sound_timer = this->sound_timer;
+  chip8.rand_generator = this->rand_generator;
+  chip8.memory_hash = this->memory_hash;
+  chip8.display_hash = this->display_hash;
+
+  chip8.snapshot_id = this->id;
+  chip8.dirty_pages = 0;
+  chip8.dirty_rows = 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "chip8.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+const size_t DISPLAY_PAGE_ROWS = 8;
+const size_t DISPLAY_PAGES = VIDEO_HEIGHT / DISPLAY_PAGE_ROWS;
+const size_t DISPLAY_PAGE_SIZE = DISPLAY_PAGE_ROWS * VIDEO_WIDTH / 8;
+
+/*
+ * Machine snapshot split into reference counted, immutable pages: 16 pages
+ * of memory and 4 pages of packed display.
+ *
+ * Capturing with a parent shares every page the machine hasn't written
+ * since it last matched that parent, so a rewind buffer or a search tree of
+ * snapshots only pays for the pages each step actually touched. The live
+ * machine stays flat, write tracking in the core is a bit per page.
+ */
+class PagedSnapshot {
+public:
+  /*
+   * Captures `chip8`. If the machine was last captured to or restored from
+   * `parent`, unwritten pages are shared with it, otherwise everything is
+   * copied. Either way the machine then matches the new snapshot.
+   */
+  PagedSnapshot(Chip8 &chip8, const PagedSnapshot *parent = nullptr);
+
+  /*
+   * Restores the machine, afterwards it matches this snapshot.
+   */
+  void restore(Chip8 &chip8) const;
+
+  /*
+   * Bytes this snapshot allocated, pages shared with its parent excluded.
+   */
+  size_t owned_bytes() const { return this->allocated; }
+
+private:
+  struct MemoryPage {
+    uint8_t bytes[MEMORY_PAGE_SIZE];
+  };
+
+  struct DisplayPage {
+    uint8_t bytes[DISPLAY_PAGE_SIZE];
+  };
+
+  std::shared_ptr<const MemoryPage> memory[MEMORY_PAGES];
+  std::shared_ptr<const DisplayPage> display[DISPLAY_PAGES];
+
+  uint8_t registers[16];
+  uint16_t index;
+  uint16_t pc;
+  uint16_t stack[16];
+  uint8_t sp;
+  uint8_t delay_timer;
+  uint8_t sound_timer;
+  uint8_t keypad[16];
+  std::minstd_rand rand_generator;
+
+  // incremental hashes, restored as is instead of recomputed.
+  uint64_t memory_hash;
+  uint64_t display_hash;
+
+  uint64_t id;
+  size_t allocated;
+
+  static std::atomic<uint64_t> next_id;
+};
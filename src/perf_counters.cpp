@@ -0,0 +1,61 @@
+#include "perf_counters.h"
+
+// length of the window rates are averaged over.
+static const double RATE_WINDOW = 0.5;
+
+void PerfCounters::frame(const Chip8Counters &counters, unsigned int ipf,
+                         int64_t emulate_us) {
+  auto now = Clock::now();
+
+  if (this->last_frame != Clock::time_point()) {
+    uint64_t frames = this->frames.load(std::memory_order_relaxed);
+    this->frame_us[frames % HISTORY].store(us_between(this->last_frame, now),
+                                           std::memory_order_relaxed);
+    this->frames.store(frames + 1, std::memory_order_release);
+  }
+  this->last_frame = now;
+
+  this->ipf.store(ipf, std::memory_order_relaxed);
+  this->emulate_us.store(emulate_us, std::memory_order_relaxed);
+  this->idle_skips.store(counters.idle_skips, std::memory_order_relaxed);
+
+  double elapsed = std::chrono::duration<double>(now - this->window_start)
+                       .count();
+  if (elapsed < RATE_WINDOW) {
+    return;
+  }
+
+  if (this->window_start != Clock::time_point()) {
+    uint64_t instructions =
+        counters.instructions - this->window_counters.instructions;
+    uint64_t draws = counters.draws - this->window_counters.draws;
+    uint64_t skipped = counters.skipped - this->window_counters.skipped;
+
+    this->instructions_per_second.store(instructions / elapsed,
+                                        std::memory_order_relaxed);
+    this->draw_share.store(instructions ? (double)draws / instructions : 0.0,
+                           std::memory_order_relaxed);
+    this->skip_share.store(instructions ? (double)skipped / instructions : 0.0,
+                           std::memory_order_relaxed);
+  }
+
+  this->window_start = now;
+  this->window_counters = counters;
+}
+
+void PerfCounters::input(int64_t input_us) {
+  this->input_us.store(input_us, std::memory_order_relaxed);
+}
+
+void PerfCounters::presented(int64_t present_us) {
+  this->present_us.store(present_us, std::memory_order_relaxed);
+}
+
+void PerfCounters::audio(float fill) {
+  this->audio_fill.store(fill, std::memory_order_relaxed);
+}
+
+int64_t PerfCounters::us_between(Clock::time_point from, Clock::time_point to) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(to - from)
+      .count();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "chip8.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/*
+ * Timings and rates published by the scheduler once per frame for the
+ * performance overlay.
+ *
+ * Every field is a relaxed atomic written by a single thread, so the overlay
+ * can read them from any thread without ever blocking emulation. Fields may
+ * be from different frames, which doesn't matter for a display.
+ */
+class PerfCounters {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  // frame times kept for the graph, 3 seconds at 60Hz.
+  static const size_t HISTORY = 180;
+
+  /*
+   * Emulation thread, a frame was emulated, `emulate_us` is the time spent
+   * in RunFrame.
+   */
+  void frame(const Chip8Counters &counters, unsigned int ipf,
+             int64_t emulate_us);
+
+  /*
+   * Render thread, time spent polling input and presenting a frame.
+   */
+  void input(int64_t input_us);
+  void presented(int64_t present_us);
+
+  /*
+   * Emulation thread, audio buffer fill from 0 to 1.
+   */
+  void audio(float fill);
+
+  static int64_t us_between(Clock::time_point from, Clock::time_point to);
+
+  // rates over the last half second.
+  std::atomic<double> instructions_per_second{0};
+  std::atomic<double> draw_share{0};
+  std::atomic<double> skip_share{0};
+
+  std::atomic<uint32_t> ipf{0};
+  std::atomic<int64_t> input_us{0};
+  std::atomic<int64_t> emulate_us{0};
+  std::atomic<int64_t> present_us{0};
+  std::atomic<uint64_t> idle_skips{0};
+  std::atomic<float> audio_fill{0};
+
+  // time between consecutive frames, the newest is at
+  // (frames - 1) % HISTORY.
+  std::atomic<int64_t> frame_us[HISTORY]{};
+  std::atomic<uint64_t> frames{0};
+
+private:
+  // publisher state.
+  Clock::time_point last_frame;
+  Clock::time_point window_start;
+  Chip8Counters window_counters{};
+};
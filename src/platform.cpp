@@ -1,14 +1,17 @@
 #include "platform.h"
+#include <cctype>
 
 Platform::Platform(const char *title, size_t window_width, size_t window_height,
-                   size_t texture_width, size_t texture_height) {
+                   size_t texture_width, size_t texture_height, bool vsync) {
   // init window
   SDL_Init(SDL_INIT_VIDEO);
   this->window = SDL_CreateWindow(title, 0, 0, window_width, window_height,
                                   SDL_WINDOW_SHOWN);
   // renderer.
-  this->renderer =
-      SDL_CreateRenderer(this->window, -1, SDL_RENDERER_ACCELERATED);
+  this->renderer = SDL_CreateRenderer(
+      this->window, -1,
+      SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0));
+  SDL_SetRenderDrawBlendMode(this->renderer, SDL_BLENDMODE_BLEND);
 
   // texture.
   this->texture = SDL_CreateTexture(this->renderer, SDL_PIXELFORMAT_RGBA8888,
@@ -27,8 +30,25 @@ Platform::~Platform() {
 
 void Platform::update(void const *buffer, int pitch) {
   SDL_UpdateTexture(this->texture, nullptr, buffer, pitch);
+  this->present();
+}
+
+void Platform::update_region(int x, int y, int w, int h, void const *buffer,
+                             int pitch) {
+  SDL_Rect rect{x, y, w, h};
+  SDL_UpdateTexture(this->texture, &rect, buffer, pitch);
+}
+
+void Platform::present() {
   SDL_RenderClear(this->renderer);
   SDL_RenderCopy(this->renderer, this->texture, nullptr, nullptr);
+
+  for (Overlay &overlay : this->overlays) {
+    if (overlay.visible) {
+      overlay.draw(*this);
+    }
+  }
+
   SDL_RenderPresent(this->renderer);
 }
 
@@ -45,146 +65,159 @@ bool Platform::process_input(uint8_t *keys) {
 
       // if keydown event.
     case SDL_KEYDOWN: {
-      //  check typeof keydown event.
-      switch (event.key.keysym.sym) {
-      case SDLK_ESCAPE: {
+      if (event.key.keysym.sym == SDLK_ESCAPE) {
         quit = true;
-      } break;
-
-      case SDLK_x: {
-        keys[0] = 1;
-      } break;
-
-      case SDLK_1: {
-        keys[1] = 1;
-      } break;
-
-      case SDLK_2: {
-        keys[2] = 1;
-      } break;
-
-      case SDLK_3: {
-        keys[3] = 1;
-      } break;
-
-      case SDLK_q: {
-        keys[4] = 1;
-      } break;
-
-      case SDLK_w: {
-        keys[5] = 1;
-      } break;
+        break;
+      }
 
-      case SDLK_e: {
-        keys[6] = 1;
-      } break;
+      int key = map_key(event.key.keysym.sym);
+      if (key >= 0) {
+        keys[key] = 1;
+        if (!event.key.repeat && this->key_down_listener) {
+          this->key_down_listener(key);
+        }
+        break;
+      }
 
-      case SDLK_a: {
-        keys[7] = 1;
-      } break;
+      if (event.key.repeat) {
+        break;
+      }
 
-      case SDLK_s: {
-        keys[8] = 1;
-      } break;
+      for (Overlay &overlay : this->overlays) {
+        if (overlay.toggle_key == event.key.keysym.sym) {
+          overlay.visible = !overlay.visible;
+        }
+      }
+    } break;
 
-      case SDLK_d: {
-        keys[9] = 1;
-      } break;
+    case SDL_KEYUP: {
+      int key = map_key(event.key.keysym.sym);
+      if (key >= 0) {
+        keys[key] = 0;
+      }
+    } break;
+    }
+  }
+  return quit;
+}
 
-      case SDLK_z: {
-        keys[0xA] = 1;
-      } break;
+int Platform::map_key(SDL_Keycode key) {
+  switch (key) {
+  case SDLK_x:
+    return 0;
+  case SDLK_1:
+    return 1;
+  case SDLK_2:
+    return 2;
+  case SDLK_3:
+    return 3;
+  case SDLK_q:
+    return 4;
+  case SDLK_w:
+    return 5;
+  case SDLK_e:
+    return 6;
+  case SDLK_a:
+    return 7;
+  case SDLK_s:
+    return 8;
+  case SDLK_d:
+    return 9;
+  case SDLK_z:
+    return 0xA;
+  case SDLK_c:
+    return 0xB;
+  case SDLK_4:
+    return 0xC;
+  case SDLK_r:
+    return 0xD;
+  case SDLK_f:
+    return 0xE;
+  case SDLK_v:
+    return 0xF;
+  default:
+    return -1;
+  }
+}
 
-      case SDLK_c: {
-        keys[0xB] = 1;
-      } break;
+void Platform::add_overlay(SDL_Keycode toggle_key, bool visible,
+                           std::function<void(Platform &)> draw) {
+  this->overlays.push_back(Overlay{toggle_key, visible, std::move(draw)});
+}
 
-      case SDLK_4: {
-        keys[0xC] = 1;
-      } break;
+void Platform::set_key_down_listener(std::function<void(uint8_t)> listener) {
+  this->key_down_listener = std::move(listener);
+}
 
-      case SDLK_r: {
-        keys[0xD] = 1;
-      } break;
+// ======================================================
+// ================= Overlay drawing ====================
+// ======================================================
+
+struct Glyph {
+  char c;
+
+  // 5 rows of 3 pixels, msb is the leftmost pixel.
+  uint8_t rows[5];
+};
+
+static const Glyph FONT_3X5[] = {
+    {'0', {7, 5, 5, 5, 7}}, {'1', {2, 6, 2, 2, 7}}, {'2', {7, 1, 7, 4, 7}},
+    {'3', {7, 1, 7, 1, 7}}, {'4', {5, 5, 7, 1, 1}}, {'5', {7, 4, 7, 1, 7}},
+    {'6', {7, 4, 7, 5, 7}}, {'7', {7, 1, 1, 2, 2}}, {'8', {7, 5, 7, 5, 7}},
+    {'9', {7, 5, 7, 1, 7}}, {'A', {2, 5, 7, 5, 5}}, {'B', {6, 5, 6, 5, 6}},
+    {'C', {3, 4, 4, 4, 3}}, {'D', {6, 5, 5, 5, 6}}, {'E', {7, 4, 6, 4, 7}},
+    {'F', {7, 4, 6, 4, 4}}, {'G', {3, 4, 5, 5, 3}}, {'H', {5, 5, 7, 5, 5}},
+    {'I', {7, 2, 2, 2, 7}}, {'J', {1, 1, 1, 5, 2}}, {'K', {5, 5, 6, 5, 5}},
+    {'L', {4, 4, 4, 4, 7}}, {'M', {5, 7, 7, 5, 5}}, {'N', {6, 5, 5, 5, 5}},
+    {'O', {2, 5, 5, 5, 2}}, {'P', {6, 5, 6, 4, 4}}, {'Q', {2, 5, 5, 6, 3}},
+    {'R', {6, 5, 6, 5, 5}}, {'S', {3, 4, 2, 1, 6}}, {'T', {7, 2, 2, 2, 2}},
+    {'U', {5, 5, 5, 5, 7}}, {'V', {5, 5, 5, 5, 2}}, {'W', {5, 5, 7, 7, 5}},
+    {'X', {5, 5, 2, 5, 5}}, {'Y', {5, 5, 2, 2, 2}}, {'Z', {7, 1, 2, 4, 7}},
+    {'.', {0, 0, 0, 0, 2}}, {':', {0, 2, 0, 2, 0}}, {'%', {5, 1, 2, 4, 5}},
+    {'/', {1, 1, 2, 4, 4}}, {'-', {0, 0, 7, 0, 0}}, {'=', {0, 7, 0, 7, 0}},
+    {'<', {1, 2, 4, 2, 1}}, {'>', {4, 2, 1, 2, 4}},
+};
+
+void Platform::fill_rect(int x, int y, int w, int h, uint32_t rgba) {
+  SDL_Rect rect{x, y, w, h};
+  SDL_SetRenderDrawColor(this->renderer, rgba >> 24u, (rgba >> 16u) & 0xFFu,
+                         (rgba >> 8u) & 0xFFu, rgba & 0xFFu);
+  SDL_RenderFillRect(this->renderer, &rect);
+}
 
-      case SDLK_f: {
-        keys[0xE] = 1;
-      } break;
+void Platform::draw_text(int x, int y, int size, uint32_t rgba,
+                         const char *text) {
+  SDL_SetRenderDrawColor(this->renderer, rgba >> 24u, (rgba >> 16u) & 0xFFu,
+                         (rgba >> 8u) & 0xFFu, rgba & 0xFFu);
 
-      case SDLK_v: {
-        keys[0xF] = 1;
-      } break;
+  for (; *text; text++, x += 4 * size) {
+    char c = std::toupper((unsigned char)*text);
+    for (const Glyph &glyph : FONT_3X5) {
+      if (glyph.c != c) {
+        continue;
       }
-    } break;
 
-    case SDL_KEYUP: {
-      switch (event.key.keysym.sym) {
-      case SDLK_x: {
-        keys[0] = 0;
-      } break;
-
-      case SDLK_1: {
-        keys[1] = 0;
-      } break;
-
-      case SDLK_2: {
-        keys[2] = 0;
-      } break;
-
-      case SDLK_3: {
-        keys[3] = 0;
-      } break;
-
-      case SDLK_q: {
-        keys[4] = 0;
-      } break;
-
-      case SDLK_w: {
-        keys[5] = 0;
-      } break;
-
-      case SDLK_e: {
-        keys[6] = 0;
-      } break;
-
-      case SDLK_a: {
-        keys[7] = 0;
-      } break;
-
-      case SDLK_s: {
-        keys[8] = 0;
-      } break;
-
-      case SDLK_d: {
-        keys[9] = 0;
-      } break;
-
-      case SDLK_z: {
-        keys[0xA] = 0;
-      } break;
-
-      case SDLK_c: {
-        keys[0xB] = 0;
-      } break;
-
-      case SDLK_4: {
-        keys[0xC] = 0;
-      } break;
-
-      case SDLK_r: {
-        keys[0xD] = 0;
-      } break;
-
-      case SDLK_f: {
-        keys[0xE] = 0;
-      } break;
-
-      case SDLK_v: {
-        keys[0xF] = 0;
-      } break;
+      for (int row = 0; row < 5; row++) {
+        for (int col = 0; col < 3; col++) {
+          if (glyph.rows[row] & (4u >> col)) {
+            SDL_Rect rect{x + col * size, y + row * size, size, size};
+            SDL_RenderFillRect(this->renderer, &rect);
+          }
+        }
       }
-    } break;
+      break;
     }
   }
-  return quit;
-}
\ No newline at end of file
+}
+
+int Platform::output_width() {
+  int w = 0, h = 0;
+  SDL_GetRendererOutputSize(this->renderer, &w, &h);
+  return w;
+}
+
+int Platform::output_height() {
+  int w = 0, h = 0;
+  SDL_GetRendererOutputSize(this->renderer, &w, &h);
+  return h;
+}
@@ -3,12 +3,17 @@
 #define SDL_MAIN_HANDLED
 
 #include <SDL2/SDL.h>
+#include <functional>
 #include <stddef.h>
+#include <vector>
 
 class Platform {
 public:
+  /*
+   * With `vsync` present() waits for the display refresh.
+   */
   Platform(const char *title, size_t window_width, size_t window_height,
-           size_t texture_width, size_t texture_height);
+           size_t texture_width, size_t texture_height, bool vsync = false);
 
   ~Platform();
 
@@ -17,13 +22,60 @@ public:
    */
   void update(void const *buffer, int pitch);
 
+  /*
+   * Uploads part of the texture, in texture pixels, without presenting.
+   */
+  void update_region(int x, int y, int w, int h, void const *buffer,
+                     int pitch);
+
+  /*
+   * Draws the texture and visible overlays and presents them.
+   */
+  void present();
+
   /*
    * Take events, input from window and user.
    */
   bool process_input(uint8_t *keys);
 
+  /*
+   * Registers an overlay drawn on top of the display, `toggle_key` shows or
+   * hides it.
+   */
+  void add_overlay(SDL_Keycode toggle_key, bool visible,
+                   std::function<void(Platform &)> draw);
+
+  /*
+   * Called with the chip8 key index on every fresh keydown.
+   */
+  void set_key_down_listener(std::function<void(uint8_t)> listener);
+
+  /*
+   * Drawing helpers for overlays, in window pixels.
+   */
+  void fill_rect(int x, int y, int w, int h, uint32_t rgba);
+  void draw_text(int x, int y, int size, uint32_t rgba, const char *text);
+
+  int output_width();
+  int output_height();
+
+private:
+  struct Overlay {
+    SDL_Keycode toggle_key;
+    bool visible;
+    std::function<void(Platform &)> draw;
+  };
+
+  /*
+   * Maps a keyboard key to a chip8 key index, -1 if it isn't one.
+   */
+  static int map_key(SDL_Keycode key);
+
 private:
   SDL_Window *window{};
   SDL_Renderer *renderer{};
   SDL_Texture *texture{};
-};
\ No newline at end of file
+
+  std::vector<Overlay> overlays;
+  std::function<void(uint8_t)> key_down_listener;
+};
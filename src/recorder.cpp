@@ -0,0 +1,265 @@
+#include "recorder.h"
+#include <chrono>
+#include <cstring>
+
+Recorder::Recorder(std::string filename, RecordFormat format, bool blocking)
+    : file(filename, std::ios::binary | std::ios::trunc), format(format),
+      blocking(blocking) {
+  if (!this->file.is_open()) {
+    nhlog_error("Failed to open record file %s.", filename.c_str());
+  }
+
+  this->write_header();
+  this->encoder = std::thread(&Recorder::encode_loop, this);
+  nhlog_info("recording to %s.", filename.c_str());
+}
+
+Recorder::~Recorder() {
+  if (this->has_pending) {
+    this->flush_pending();
+  }
+
+  this->stop.store(true, std::memory_order_release);
+  this->encoder.join();
+  this->write_trailer();
+  this->file.close();
+
+  if (this->dropped > 0) {
+    nhlog_warn("recorder dropped %llu frames, encoder could not keep up.",
+               (unsigned long long)this->dropped);
+  }
+  nhlog_info("recorded %llu frames.", (unsigned long long)this->frames_written);
+}
+
+bool Recorder::parse_format(const std::string &name, RecordFormat &format) {
+  if (name == "raw") {
+    format = RecordFormat::RAW;
+  } else if (name == "y4m") {
+    format = RecordFormat::Y4M;
+  } else if (name == "gif") {
+    format = RecordFormat::GIF;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void Recorder::submit(const Chip8 &chip8) {
+  uint8_t pixels[PACKED_DISPLAY_SIZE];
+  chip8.pack_display(pixels);
+
+  // same image as last frame, just show it for longer.
+  if (this->has_pending &&
+      std::memcmp(pixels, this->pending.pixels, sizeof(pixels)) == 0) {
+    this->pending.repeat++;
+    return;
+  }
+
+  if (this->has_pending) {
+    this->flush_pending();
+  }
+
+  std::memcpy(this->pending.pixels, pixels, sizeof(pixels));
+  this->pending.repeat = 1;
+  this->has_pending = true;
+}
+
+void Recorder::flush_pending() {
+  while (!this->queue.push(this->pending)) {
+    if (!this->blocking) {
+      this->dropped += this->pending.repeat;
+      break;
+    }
+    std::this_thread::yield();
+  }
+  this->has_pending = false;
+}
+
+void Recorder::encode_loop() {
+  Frame frame;
+  while (true) {
+    if (this->queue.pop(frame)) {
+      this->write_frame(frame);
+      continue;
+    }
+
+    // only stop once the queue has been drained.
+    if (this->stop.load(std::memory_order_acquire)) {
+      if (!this->queue.pop(frame)) {
+        break;
+      }
+      this->write_frame(frame);
+      continue;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+// ======================================================
+// =================== Encoders =========================
+// ======================================================
+
+static void write_u16(std::ofstream &file, uint16_t value) {
+  file.put(value & 0xFFu);
+  file.put(value >> 8u);
+}
+
+void Recorder::write_header() {
+  switch (this->format) {
+  case RecordFormat::RAW:
+    break;
+
+  case RecordFormat::Y4M: {
+    this->file << "YUV4MPEG2 W" << VIDEO_WIDTH << " H" << VIDEO_HEIGHT
+               << " F60:1 Ip A1:1 Cmono\n";
+  } break;
+
+  case RecordFormat::GIF: {
+    this->file.write("GIF89a", 6);
+    write_u16(this->file, VIDEO_WIDTH);
+    write_u16(this->file, VIDEO_HEIGHT);
+
+    // global color table with 2 entries, black and white.
+    this->file.put((char)0x80);
+    this->file.put(0);
+    this->file.put(0);
+    const char palette[6] = {0, 0, 0, '\xFF', '\xFF', '\xFF'};
+    this->file.write(palette, sizeof(palette));
+
+    // netscape extension, loop forever.
+    this->file.write("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 19);
+  } break;
+  }
+}
+
+void Recorder::write_frame(const Frame &frame) {
+  switch (this->format) {
+  case RecordFormat::RAW: {
+    for (uint32_t i = 0; i < frame.repeat; i++) {
+      this->file.write((const char *)frame.pixels, PACKED_DISPLAY_SIZE);
+    }
+  } break;
+
+  case RecordFormat::Y4M: {
+    char luma[VIDEO_WIDTH * VIDEO_HEIGHT];
+    for (size_t i = 0; i < sizeof(luma); i++) {
+      luma[i] = (frame.pixels[i / 8] & (0x80u >> (i % 8))) ? '\xFF' : 0;
+    }
+    for (uint32_t i = 0; i < frame.repeat; i++) {
+      this->file.write("FRAME\n", 6);
+      this->file.write(luma, sizeof(luma));
+    }
+  } break;
+
+  case RecordFormat::GIF: {
+    // gif delays are in centiseconds, derive them from the running total
+    // so rounding errors don't accumulate.
+    uint64_t start = this->frames_written * 100 / 60;
+    uint64_t end = (this->frames_written + frame.repeat) * 100 / 60;
+    uint64_t delay = end - start;
+
+    do {
+      uint16_t chunk = delay > 0xFFFF ? 0xFFFF : delay;
+      delay -= chunk;
+
+      this->file.write("\x21\xF9\x04\x00", 4);
+      write_u16(this->file, chunk);
+      this->file.write("\x00\x00", 2);
+      this->write_gif_image(frame.pixels);
+    } while (delay > 0);
+  } break;
+  }
+
+  this->frames_written += frame.repeat;
+}
+
+void Recorder::write_trailer() {
+  if (this->format == RecordFormat::GIF) {
+    this->file.put(0x3B);
+  }
+}
+
+void Recorder::write_gif_image(const uint8_t *pixels) {
+  // image descriptor covering the whole screen, no local color table.
+  this->file.put(0x2C);
+  write_u16(this->file, 0);
+  write_u16(this->file, 0);
+  write_u16(this->file, VIDEO_WIDTH);
+  write_u16(this->file, VIDEO_HEIGHT);
+  this->file.put(0);
+
+  // gif requires a minimum code size of 2 even for 2 colors.
+  const uint32_t min_code_size = 2;
+  const uint32_t clear_code = 1u << min_code_size;
+  const uint32_t eoi_code = clear_code + 1;
+
+  // dictionary, code -> next code for each of the 4 possible pixel values.
+  static thread_local uint16_t dict[4096][4];
+
+  std::vector<uint8_t> out;
+  uint32_t bit_buffer = 0;
+  uint32_t bit_count = 0;
+  uint32_t code_size = min_code_size + 1;
+  uint32_t max_code = eoi_code;
+
+  auto emit = [&](uint32_t code) {
+    bit_buffer |= code << bit_count;
+    bit_count += code_size;
+    while (bit_count >= 8) {
+      out.push_back(bit_buffer & 0xFFu);
+      bit_buffer >>= 8u;
+      bit_count -= 8;
+    }
+  };
+
+  auto reset = [&]() {
+    std::memset(dict, 0, sizeof(dict));
+    code_size = min_code_size + 1;
+    max_code = eoi_code;
+  };
+
+  reset();
+  emit(clear_code);
+
+  auto pixel = [&](size_t i) -> uint8_t {
+    return (pixels[i / 8] >> (7 - i % 8)) & 1u;
+  };
+
+  uint32_t prefix = pixel(0);
+  for (size_t i = 1; i < VIDEO_WIDTH * VIDEO_HEIGHT; i++) {
+    uint8_t value = pixel(i);
+    if (dict[prefix][value]) {
+      prefix = dict[prefix][value];
+      continue;
+    }
+
+    emit(prefix);
+    dict[prefix][value] = ++max_code;
+    if (max_code >= (1u << code_size)) {
+      code_size++;
+    }
+
+    // dictionary is full, start over.
+    if (max_code == 4095) {
+      emit(clear_code);
+      reset();
+    }
+    prefix = value;
+  }
+
+  emit(prefix);
+  emit(eoi_code);
+  if (bit_count > 0) {
+    out.push_back(bit_buffer & 0xFFu);
+  }
+
+  // data goes out in sub blocks of at most 255 bytes.
+  this->file.put(min_code_size);
+  for (size_t i = 0; i < out.size(); i += 255) {
+    size_t size = out.size() - i < 255 ? out.size() - i : 255;
+    this->file.put(size);
+    this->file.write((const char *)out.data() + i, size);
+  }
+  this->file.put(0);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "chip8.h"
+#include "external/nhlog.h"
+#include "spsc_queue.h"
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class RecordFormat { RAW, Y4M, GIF };
+
+/*
+ * Captures one display frame per emulated frame and encodes it on a
+ * background thread. Identical consecutive frames are merged before they
+ * reach the queue.
+ */
+class Recorder {
+public:
+  /*
+   * `blocking` makes submit wait for queue space instead of dropping frames,
+   * used when there is no real time deadline to keep.
+   */
+  Recorder(std::string filename, RecordFormat format, bool blocking);
+
+  /*
+   * Flushes pending frames, joins the encoder thread and closes the file.
+   */
+  ~Recorder();
+
+  /*
+   * Called from the emulation thread once per frame.
+   */
+  void submit(const Chip8 &chip8);
+
+  /*
+   * Parses "raw", "y4m" or "gif", returns false for anything else.
+   */
+  static bool parse_format(const std::string &name, RecordFormat &format);
+
+private:
+  struct Frame {
+    uint8_t pixels[PACKED_DISPLAY_SIZE];
+
+    // how many emulated frames this image was shown for.
+    uint32_t repeat;
+  };
+
+  /*
+   * Pushes the pending frame into the queue.
+   */
+  void flush_pending();
+
+  /*
+   * Encoder thread entry.
+   */
+  void encode_loop();
+
+  void write_header();
+  void write_frame(const Frame &frame);
+  void write_trailer();
+
+  /*
+   * Writes an lzw compressed, 1 bit per pixel gif image block.
+   */
+  void write_gif_image(const uint8_t *pixels);
+
+private:
+  std::ofstream file;
+  RecordFormat format;
+  bool blocking;
+
+  Frame pending{};
+  bool has_pending = false;
+  uint64_t dropped = 0;
+
+  // total emulated frames written so far, used to derive gif delays.
+  uint64_t frames_written = 0;
+
+  std::atomic<bool> stop{false};
+  SpscQueue<Frame, 256> queue;
+  std::thread encoder;
+};
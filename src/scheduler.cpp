@@ -0,0 +1,130 @@
+#include "scheduler.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
+// constructor.
+Scheduler::Scheduler(unsigned int ipf, bool realtime, size_t capacity)
+    : ipf(ipf), realtime(realtime), pool(capacity) {
+  this->vms.reserve(capacity);
+}
+
+size_t Scheduler::add(const Chip8 &chip8) {
+  Vm vm;
+  vm.chip8 = this->pool.acquire(chip8);
+  if (!vm.chip8) {
+    nhlog_error("Scheduler is full, it holds %zu machines.",
+                this->pool.capacity());
+    exit(EXIT_FAILURE);
+  }
+  this->vms.push_back(vm);
+  return this->vms.size() - 1;
+}
+
+void Scheduler::set_keypad(size_t vm, uint16_t mask) {
+  std::lock_guard<std::mutex> lock(this->inbox_mutex);
+  this->inbox.emplace_back(vm, mask);
+}
+
+VmTask Scheduler::run_vm(size_t index) {
+  // vms doesn't change size once run() started, so this stays valid.
+  Vm &vm = this->vms[index];
+  Chip8 &chip8 = *vm.chip8;
+
+  while (true) {
+    chip8.set_keypad_mask(vm.keypad);
+    Chip8Counters before = chip8.counters;
+    chip8.RunFrame(this->ipf);
+    this->frames_run++;
+    if (this->metrics) {
+      this->metrics->machine(before, chip8.counters, 1);
+    }
+
+    if (chip8.halted()) {
+      this->halted++;
+      co_return;
+    }
+
+    if (chip8.waiting_for_key()) {
+      co_await KeyPress{*this, index};
+
+      // woken during this tick, which it runs straight away. The timers
+      // kept running while parked, under VIP timing once per frame.
+      uint64_t missed = this->tick - vm.parked_at - 1;
+      this->frames_parked += missed;
+      uint64_t ticks =
+          chip8.timing() == Timing::VIP ? missed : missed * this->ipf;
+      chip8.skip_idle(std::min<uint64_t>(ticks, 0xFF));
+      continue;
+    }
+
+    co_await NextFrame{*this};
+  }
+}
+
+void Scheduler::drain_inbox() {
+  {
+    std::lock_guard<std::mutex> lock(this->inbox_mutex);
+    std::swap(this->inbox, this->inbox_local);
+  }
+
+  for (auto [index, mask] : this->inbox_local) {
+    Vm &vm = this->vms[index];
+    vm.keypad = mask;
+    if (vm.parked && mask != 0) {
+      this->ready.push_back(std::exchange(vm.parked, nullptr));
+    }
+  }
+  this->inbox_local.clear();
+}
+
+void Scheduler::run(uint64_t frames) {
+  if (this->tasks.empty()) {
+    for (size_t vm = 0; vm < this->vms.size(); vm++) {
+      this->tasks.push_back(this->run_vm(vm));
+      this->ready.push_back(this->tasks.back().handle);
+    }
+  }
+
+  const auto frame_time =
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(1.0 / 60.0));
+  auto next_tick = std::chrono::steady_clock::now();
+
+  for (uint64_t end = this->tick + frames;
+       this->tick < end && this->halted < this->vms.size(); this->tick++) {
+    auto tick_start = MetricsShard::Clock::now();
+    this->drain_inbox();
+
+    // the first resume starts the coroutine, after that each one runs a
+    // frame and suspends.
+    for (std::coroutine_handle<> handle : this->ready) {
+      handle.resume();
+    }
+    this->ready.clear();
+    std::swap(this->ready, this->next);
+
+    if (this->metrics) {
+      this->metrics->job(MetricsShard::ns_since(tick_start));
+    }
+    if (this->tick_listener) {
+      this->tick_listener();
+    }
+
+    if (this->realtime) {
+      next_tick += frame_time;
+      std::this_thread::sleep_until(next_tick);
+    }
+  }
+}
+
+uint64_t Scheduler::parked_frames() const {
+  uint64_t frames = this->frames_parked;
+  for (const Vm &vm : this->vms) {
+    if (vm.parked) {
+      frames += this->tick - vm.parked_at - 1;
+    }
+  }
+  return frames;
+}
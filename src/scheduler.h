@@ -0,0 +1,175 @@
+#pragma once
+
+#include "chip8.h"
+#include "chip8_pool.h"
+#include "external/nhlog.h"
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+struct MetricsShard;
+
+/*
+ * Coroutine running one machine, owned by the Scheduler.
+ */
+class VmTask {
+public:
+  struct promise_type {
+    VmTask get_return_object() {
+      return VmTask(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  explicit VmTask(std::coroutine_handle<promise_type> handle)
+      : handle(handle) {}
+  VmTask(VmTask &&other) noexcept
+      : handle(std::exchange(other.handle, nullptr)) {}
+  VmTask(const VmTask &) = delete;
+  VmTask &operator=(const VmTask &) = delete;
+  ~VmTask() {
+    if (this->handle) {
+      this->handle.destroy();
+    }
+  }
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+/*
+ * Cooperative scheduler running many machines on one thread.
+ *
+ * Every machine is a coroutine which runs one frame per 60Hz tick and
+ * suspends at the frame boundary. A machine waiting on Fx0A with no key
+ * down is parked until set_keypad() gives it a key, and a halted machine
+ * finishes, so neither costs anything per tick. Parked machines get their
+ * timers advanced for the frames they missed when they wake.
+ *
+ * Machines live in the scheduler's own Chip8Pool. Adding them from the
+ * thread which runs the scheduler places them on that thread's NUMA node.
+ */
+class Scheduler {
+public:
+  /*
+   * With `realtime` ticks are paced at 60Hz, otherwise they run back to
+   * back. At most `capacity` machines can be added.
+   */
+  Scheduler(unsigned int ipf, bool realtime, size_t capacity);
+
+  /*
+   * Adds a machine, returns its index for set_keypad(). Only before run().
+   */
+  size_t add(const Chip8 &chip8);
+
+  /*
+   * Runs `frames` more ticks, or until every machine halted.
+   */
+  void run(uint64_t frames);
+
+  /*
+   * Sets the keys of machine `vm` from the next tick on, waking it if it
+   * waits for a key. Can be called from any thread.
+   */
+  void set_keypad(size_t vm, uint16_t mask);
+
+  /*
+   * Counts frames and ticks into `shard`, which only this scheduler's
+   * thread may write.
+   */
+  void set_metrics(MetricsShard *shard) { this->metrics = shard; }
+
+  /*
+   * Called on the scheduler's thread after every tick.
+   */
+  void set_tick_listener(std::function<void()> listener) {
+    this->tick_listener = std::move(listener);
+  }
+
+  const Chip8 &machine(size_t vm) const { return *this->vms[vm].chip8; }
+  size_t size() const { return this->vms.size(); }
+
+  /*
+   * Frames machines missed parked on a key wait, so far.
+   */
+  uint64_t parked_frames() const;
+
+  // frames machines ran.
+  uint64_t frames_run = 0;
+
+  // machines which halted.
+  size_t halted = 0;
+
+private:
+  struct Vm {
+    Chip8 *chip8;
+    uint16_t keypad = 0;
+
+    // set while parked on a key wait, with the tick it parked at.
+    std::coroutine_handle<> parked;
+    uint64_t parked_at = 0;
+  };
+
+  /*
+   * Suspends until the next tick.
+   */
+  struct NextFrame {
+    Scheduler &scheduler;
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      this->scheduler.next.push_back(handle);
+    }
+    void await_resume() const noexcept {}
+  };
+
+  /*
+   * Suspends until the machine is given a key.
+   */
+  struct KeyPress {
+    Scheduler &scheduler;
+    size_t vm;
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      Vm &vm = this->scheduler.vms[this->vm];
+      vm.parked = handle;
+      vm.parked_at = this->scheduler.tick;
+    }
+    void await_resume() const noexcept {}
+  };
+
+  VmTask run_vm(size_t vm);
+
+  /*
+   * Applies keypad changes sent since the last tick and wakes machines.
+   */
+  void drain_inbox();
+
+private:
+  unsigned int ipf;
+  bool realtime;
+  MetricsShard *metrics = nullptr;
+  std::function<void()> tick_listener;
+
+  Chip8Pool pool;
+  std::vector<Vm> vms;
+  std::vector<VmTask> tasks;
+
+  // machines to resume this tick and the next.
+  std::vector<std::coroutine_handle<>> ready;
+  std::vector<std::coroutine_handle<>> next;
+  uint64_t tick = 0;
+
+  // frames missed by machines which have since woken.
+  uint64_t frames_parked = 0;
+
+  std::mutex inbox_mutex;
+  std::vector<std::pair<size_t, uint16_t>> inbox;
+  std::vector<std::pair<size_t, uint16_t>> inbox_local;
+};
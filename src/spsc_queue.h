@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+/*
+ * Bounded lock-free single-producer/single-consumer queue.
+ * `Capacity` must be a power of two, one slot is always kept empty.
+ */
+template <typename T, size_t Capacity> class SpscQueue {
+  static_assert((Capacity & (Capacity - 1)) == 0,
+                "SpscQueue capacity must be a power of two.");
+
+public:
+  /*
+   * Called from the producer thread, returns false if the queue is full.
+   */
+  bool push(const T &item) {
+    size_t head = this->head.load(std::memory_order_relaxed);
+    size_t next = (head + 1) & (Capacity - 1);
+    if (next == this->tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    this->items[head] = item;
+    this->head.store(next, std::memory_order_release);
+    return true;
+  }
+
+  /*
+   * Called from the consumer thread, returns false if the queue is empty.
+   */
+  bool pop(T &item) {
+    size_t tail = this->tail.load(std::memory_order_relaxed);
+    if (tail == this->head.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    item = this->items[tail];
+    this->tail.store((tail + 1) & (Capacity - 1), std::memory_order_release);
+    return true;
+  }
+
+  /*
+   * Number of queued items, only a snapshot when called concurrently.
+   */
+  size_t size() const {
+    size_t head = this->head.load(std::memory_order_acquire);
+    size_t tail = this->tail.load(std::memory_order_acquire);
+    return (head - tail) & (Capacity - 1);
+  }
+
+  static constexpr size_t capacity() { return Capacity - 1; }
+
+private:
+  // head and tail live on their own cache lines so the producer and
+  // consumer don't false share.
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+  alignas(64) T items[Capacity];
+};
@@ -0,0 +1,178 @@
+#include "stream_viewer.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// constructor.
+StreamViewer::StreamViewer(int argc, char *argv[]) {
+#ifndef CIPI8_DEBUG_MODE
+  nhlog_set_level(NHLOG_INFO);
+#else
+  nhlog_set_level(NHLOG_TRACE);
+#endif
+
+  argparse::ArgumentParser program("cipi8-view", "1.0.0");
+
+  program.add_argument("socket")
+      .help("Unix socket of a run streamed with --stream.")
+      .required();
+  program.add_argument("--scale")
+      .help("Scale of the display")
+      .default_value(15)
+      .scan<'i', int>();
+
+  try {
+    program.parse_args(argc, argv);
+  } catch (const std::exception &err) {
+    std::cerr << "Failed to parse arguments." << err.what() << std::endl;
+    std::cerr << program;
+    std::exit(1);
+  }
+
+  this->path = program.get<std::string>("socket");
+  this->scale = std::max(program.get<int>("--scale"), 1);
+
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (this->path.size() >= sizeof(address.sun_path)) {
+    nhlog_error("Stream socket path %s is too long.", this->path.c_str());
+    exit(EXIT_FAILURE);
+  }
+  std::strcpy(address.sun_path, this->path.c_str());
+
+  this->socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (this->socket < 0 ||
+      connect(this->socket, (sockaddr *)&address, sizeof(address)) != 0) {
+    nhlog_error("Failed to connect to %s: %s", this->path.c_str(),
+                std::strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
+
+StreamViewer::~StreamViewer() {
+  if (this->socket >= 0) {
+    close(this->socket);
+  }
+}
+
+int StreamViewer::run() {
+  std::string title = "cipi8 - " + this->path;
+  Platform platform = Platform(title.c_str(), VIDEO_WIDTH * this->scale,
+                               VIDEO_HEIGHT * this->scale, VIDEO_WIDTH,
+                               VIDEO_HEIGHT);
+
+  uint32_t pixels[VIDEO_WIDTH * VIDEO_HEIGHT];
+  int pitch = sizeof(pixels[0]) * VIDEO_WIDTH;
+  uint8_t keys[16]{};
+  uint16_t sent_mask = 0;
+
+  while (true) {
+    if (platform.process_input(keys)) {
+      break;
+    }
+
+    uint16_t mask = 0;
+    for (int key = 0; key < 16; key++) {
+      mask |= (keys[key] ? 1u : 0u) << key;
+    }
+    if (mask != sent_mask) {
+      this->send_keypad(mask);
+      sent_mask = mask;
+    }
+
+    // waits a few ms at most, so input stays responsive.
+    pollfd poll_socket{this->socket, POLLIN, 0};
+    if (poll(&poll_socket, 1, 4) > 0) {
+      uint8_t buffer[4096];
+      ssize_t received = recv(this->socket, buffer, sizeof(buffer), 0);
+      if (received <= 0) {
+        nhlog_info("stream ended.");
+        break;
+      }
+      this->bytes += received;
+      this->in.insert(this->in.end(), buffer, buffer + received);
+      if (!this->apply_messages()) {
+        nhlog_error("Malformed stream from %s.", this->path.c_str());
+        return EXIT_FAILURE;
+      }
+    }
+
+    if (this->changed) {
+      for (size_t i = 0; i < VIDEO_WIDTH * VIDEO_HEIGHT; i++) {
+        bool on = this->display[i / 8] & (0x80u >> (i % 8));
+        pixels[i] = on ? 0xFFFFFFFF : 0;
+      }
+      platform.update(pixels, pitch);
+      this->changed = false;
+    }
+  }
+
+  nhlog_info("received %llu frames in %llu bytes.",
+             (unsigned long long)this->frames,
+             (unsigned long long)this->bytes);
+  return EXIT_SUCCESS;
+}
+
+bool StreamViewer::apply_messages() {
+  size_t at = 0;
+  while (this->in.size() - at >= STREAM_HEADER_SIZE) {
+    uint8_t type = this->in[at];
+    size_t size = this->in[at + 1] | (this->in[at + 2] << 8u);
+    if (this->in.size() - at < STREAM_HEADER_SIZE + size) {
+      break;
+    }
+    const uint8_t *payload = this->in.data() + at + STREAM_HEADER_SIZE;
+    at += STREAM_HEADER_SIZE + size;
+
+    switch (type) {
+    case STREAM_HELLO:
+      if (size < 7 || std::memcmp(payload, "C8FS", 4) != 0 ||
+          payload[4] != STREAM_VERSION || payload[5] != VIDEO_WIDTH ||
+          payload[6] != VIDEO_HEIGHT) {
+        return false;
+      }
+      this->greeted = true;
+      break;
+
+    case STREAM_KEYFRAME:
+      if (!this->greeted || size != 4 + PACKED_DISPLAY_SIZE) {
+        return false;
+      }
+      std::memcpy(this->display, payload + 4, PACKED_DISPLAY_SIZE);
+      this->frames++;
+      this->changed = true;
+      break;
+
+    case STREAM_DELTA:
+      if (!this->greeted || size < 4 ||
+          !stream_apply_delta(payload + 4, size - 4, this->display)) {
+        return false;
+      }
+      this->frames++;
+      this->changed = true;
+      break;
+
+    default:
+      // skipped, for servers of newer versions.
+      break;
+    }
+  }
+  this->in.erase(this->in.begin(), this->in.begin() + at);
+  return true;
+}
+
+void StreamViewer::send_keypad(uint16_t mask) {
+  std::vector<uint8_t> message;
+  stream_write_header(message, STREAM_KEYPAD, 2);
+  message.push_back(mask & 0xFFu);
+  message.push_back(mask >> 8u);
+  ::send(this->socket, message.data(), message.size(), MSG_NOSIGNAL);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "chip8.h"
+#include "external/argparse.hpp"
+#include "external/nhlog.h"
+#include "frame_stream.h"
+#include "platform.h"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * Window showing a display streamed by a StreamServer, such as a farm
+ * instance run with --stream. Keys held in the window are sent back.
+ */
+class StreamViewer {
+public:
+  std::string path;
+  int scale;
+
+public:
+  StreamViewer(int argc, char *argv[]);
+  ~StreamViewer();
+
+  /*
+   * Shows the stream until the window is closed or the stream ends.
+   */
+  int run();
+
+private:
+  /*
+   * Applies the complete messages received, false if the stream is
+   * malformed.
+   */
+  bool apply_messages();
+
+  void send_keypad(uint16_t mask);
+
+private:
+  int socket = -1;
+
+  std::vector<uint8_t> in;
+  uint8_t display[PACKED_DISPLAY_SIZE]{};
+  bool greeted = false;
+  bool changed = false;
+
+  uint64_t frames = 0;
+  uint64_t bytes = 0;
+};
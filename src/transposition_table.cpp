@@ -0,0 +1,66 @@
+#include "transposition_table.h"
+
+// longest probe sequence before giving up on a hash.
+const size_t MAX_PROBES = 64;
+
+TranspositionTable::TranspositionTable(unsigned int capacity_log2)
+    : slots(std::make_unique<std::atomic<uint64_t>[]>((size_t)1
+                                                      << capacity_log2)),
+      mask(((size_t)1 << capacity_log2) - 1) {
+  this->clear();
+}
+
+bool TranspositionTable::insert(uint64_t hash) {
+  hash = normalize(hash);
+
+  size_t slot = hash & this->mask;
+  for (size_t probe = 0; probe < MAX_PROBES; probe++) {
+    std::atomic<uint64_t> &entry = this->slots[(slot + probe) & this->mask];
+
+    uint64_t current = entry.load(std::memory_order_relaxed);
+    if (current == hash) {
+      return false;
+    }
+
+    if (current == 0) {
+      if (entry.compare_exchange_strong(current, hash,
+                                        std::memory_order_relaxed)) {
+        this->count.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+
+      // another thread claimed the slot, it may have stored the same hash.
+      if (current == hash) {
+        return false;
+      }
+    }
+  }
+
+  this->overflow_count.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool TranspositionTable::contains(uint64_t hash) const {
+  hash = normalize(hash);
+
+  size_t slot = hash & this->mask;
+  for (size_t probe = 0; probe < MAX_PROBES; probe++) {
+    uint64_t current =
+        this->slots[(slot + probe) & this->mask].load(std::memory_order_relaxed);
+    if (current == hash) {
+      return true;
+    }
+    if (current == 0) {
+      return false;
+    }
+  }
+  return false;
+}
+
+void TranspositionTable::clear() {
+  for (size_t i = 0; i <= this->mask; i++) {
+    this->slots[i].store(0, std::memory_order_relaxed);
+  }
+  this->count.store(0, std::memory_order_relaxed);
+  this->overflow_count.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/*
+ * Concurrent set of state hashes, for skipping states a search has already
+ * visited. Open addressing with linear probing, insertion is a single CAS
+ * and there is no removal.
+ */
+class TranspositionTable {
+public:
+  /*
+   * Holds up to 2^capacity_log2 hashes.
+   */
+  explicit TranspositionTable(unsigned int capacity_log2);
+
+  /*
+   * Returns true if `hash` was not in the table. When the probe sequence is
+   * full the hash is reported as new without being stored, see overflows().
+   */
+  bool insert(uint64_t hash);
+
+  bool contains(uint64_t hash) const;
+
+  size_t size() const { return this->count.load(std::memory_order_relaxed); }
+
+  size_t capacity() const { return this->mask + 1; }
+
+  size_t overflows() const {
+    return this->overflow_count.load(std::memory_order_relaxed);
+  }
+
+  void clear();
+
+private:
+  // 0 marks an empty slot, so hash 0 is stored as 1.
+  static uint64_t normalize(uint64_t hash) { return hash ? hash : 1; }
+
+private:
+  std::unique_ptr<std::atomic<uint64_t>[]> slots;
+  size_t mask;
+  std::atomic<size_t> count{0};
+  std::atomic<size_t> overflow_count{0};
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Lock-free triple buffer for one producer and one consumer thread.
+ *
+ * The producer fills back() and publish()es it, the consumer calls update()
+ * and reads front(). Neither side ever waits, the producer can publish
+ * faster than the consumer reads and the consumer always gets the newest
+ * published value.
+ */
+template <typename T> class TripleBuffer {
+public:
+  /*
+   * Producer side, buffer to write the next value into.
+   */
+  T &back() { return this->buffers[this->back_index]; }
+
+  /*
+   * Producer side, makes back() the newest value and hands over a free
+   * buffer to write the next one into.
+   */
+  void publish() {
+    uint8_t previous = this->middle.exchange(this->back_index | FRESH,
+                                             std::memory_order_acq_rel);
+    this->back_index = previous & INDEX;
+  }
+
+  /*
+   * Consumer side, takes the newest published value if there is one.
+   * Returns true if front() changed.
+   */
+  bool update() {
+    if (!(this->middle.load(std::memory_order_relaxed) & FRESH)) {
+      return false;
+    }
+
+    uint8_t previous =
+        this->middle.exchange(this->front_index, std::memory_order_acq_rel);
+    this->front_index = previous & INDEX;
+    return true;
+  }
+
+  /*
+   * Consumer side, newest value taken by update().
+   */
+  const T &front() const { return this->buffers[this->front_index]; }
+
+private:
+  static const uint8_t INDEX = 0x3;
+
+  // set while middle holds a value the consumer hasn't taken.
+  static const uint8_t FRESH = 0x4;
+
+  T buffers[3]{};
+
+  // each index is owned by exactly one side, middle is the exchange slot.
+  uint8_t back_index = 0;
+  std::atomic<uint8_t> middle{1};
+  uint8_t front_index = 2;
+};
@@ -0,0 +1,6 @@
+#include "stream_viewer.h"
+
+int main(int argc, char *argv[]) {
+  StreamViewer viewer = StreamViewer(argc, argv);
+  return viewer.run();
+}